@@ -0,0 +1,188 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+#include "glad/glad.h"
+
+#include "profiler.h"
+
+/* Scene Benchmark */
+
+bool ParseBenchmarkArguments(int argc, char* argv[], BenchmarkSettings& settings)
+{
+	bool headless = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* option = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (std::strcmp(option, "--headless") == 0)
+			headless = true;
+		else if (std::strcmp(option, "--pulling") == 0)
+			settings.vertex_pulling = true;
+		else if (std::strcmp(option, "--strips") == 0)
+			settings.triangle_strips = true;
+		else if (std::strcmp(option, "--frames") == 0 && value && std::sscanf(value, "%d", &settings.frames) == 1)
+			++i;
+		else if (std::strcmp(option, "--warmup") == 0 && value && std::sscanf(value, "%d", &settings.warmup_frames) == 1)
+			++i;
+		else if (std::strcmp(option, "--retune") == 0 && value && std::sscanf(value, "%d", &settings.retune_frames) == 1)
+			++i;
+		else if (std::strcmp(option, "--upload-budget") == 0 && value && std::sscanf(value, "%d", &settings.upload_budget_kb) == 1)
+			++i;
+		else if (std::strcmp(option, "--size") == 0 && value && std::sscanf(value, "%dx%d", &settings.resolution.x, &settings.resolution.y) == 2)
+			++i;
+		else if (std::strcmp(option, "--report") == 0 && value)
+		{
+			settings.report_path = value;
+			++i;
+		}
+		else if (std::strcmp(option, "--profile") == 0 && value)
+		{
+			settings.trace_path = value;
+			++i;
+		}
+		else if (std::strcmp(option, "--scenes") == 0 && value)
+		{
+			settings.scenes.clear();
+			std::stringstream list(value);
+			std::string scene;
+			while (std::getline(list, scene, ','))
+				if (!scene.empty())
+					settings.scenes.push_back(std::atoi(scene.c_str()));
+			++i;
+		}
+		else
+			std::cout << "Error: Unknown or incomplete option " << option << std::endl;
+	}
+
+	settings.frames = std::max(settings.frames, 1);
+	settings.warmup_frames = std::max(settings.warmup_frames, 0);
+	settings.retune_frames = std::max(settings.retune_frames, 0);
+	settings.upload_budget_kb = std::max(settings.upload_budget_kb, 1);
+	settings.resolution = glm::max(settings.resolution, glm::ivec2(1));
+	return headless;
+}
+
+SceneBenchmark::SceneBenchmark(const BenchmarkSettings& settings)
+	: settings(settings)
+{
+	for (int scene : settings.scenes)
+	{
+		SceneResult result;
+		result.scene = scene;
+		results.push_back(result);
+	}
+}
+
+bool SceneBenchmark::Running() const
+{
+	return scene_index < results.size();
+}
+
+int SceneBenchmark::Scene() const
+{
+	return results[scene_index].scene;
+}
+
+double SceneBenchmark::Time() const
+{
+	return total_frames / 60.0;
+}
+
+void SceneBenchmark::BeginFrame()
+{
+	frame_start = std::chrono::steady_clock::now();
+}
+
+void SceneBenchmark::EndFrame(int draw_calls, long long triangles)
+{
+	glFinish();
+	std::chrono::duration<double, std::milli> frame_time = std::chrono::steady_clock::now() - frame_start;
+
+	// scenes are half drawn while meshes stream in, so those frames are neither warmup nor measured
+	if (fully_loaded_ms < 0)
+		return;
+
+	SceneResult& result = results[scene_index];
+	if (frame >= settings.warmup_frames)
+	{
+		result.frame_ms.push_back(frame_time.count());
+		result.draw_calls.push_back(draw_calls);
+		result.triangles.push_back(triangles);
+	}
+
+	++total_frames;
+	if (++frame == settings.warmup_frames + settings.frames)
+	{
+		frame = 0;
+		++scene_index;
+	}
+}
+
+// Nearest-rank percentile of sorted values.
+static double Percentile(const std::vector<double>& sorted, double percent)
+{
+	size_t rank = size_t(std::ceil(percent / 100 * sorted.size()));
+	return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+}
+
+bool SceneBenchmark::WriteReport(const std::string& renderer) const
+{
+	std::ofstream file(settings.report_path, std::ios::trunc);
+	file << "{\n";
+	file << "  \"renderer\": " << JsonString(renderer) << ",\n";
+	file << "  \"resolution\": [" << settings.resolution.x << ", " << settings.resolution.y << "],\n";
+	file << "  \"frames\": " << settings.frames << ",\n";
+	file << "  \"warmup_frames\": " << settings.warmup_frames << ",\n";
+	file << "  \"vertex_pulling\": " << (settings.vertex_pulling ? "true" : "false") << ",\n";
+	file << "  \"triangle_strips\": " << (settings.triangle_strips ? "true" : "false") << ",\n";
+	file << "  \"retune_frames\": " << settings.retune_frames << ",\n";
+	file << "  \"upload_budget_kb\": " << settings.upload_budget_kb << ",\n";
+	file << "  \"first_frame_ms\": " << first_frame_ms << ",\n";
+	file << "  \"fully_loaded_ms\": " << fully_loaded_ms << ",\n";
+	file << "  \"scenes\": [\n";
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const SceneResult& result = results[i];
+		std::vector<double> sorted = result.frame_ms;
+		std::sort(sorted.begin(), sorted.end());
+
+		double count = double(sorted.size());
+		double mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / count;
+		double draw_calls = std::accumulate(result.draw_calls.begin(), result.draw_calls.end(), 0.0) / count;
+		double triangles = std::accumulate(result.triangles.begin(), result.triangles.end(), 0.0) / count;
+
+		file << "    { \"scene\": " << result.scene
+			<< ", \"mean_ms\": " << mean
+			<< ", \"p50_ms\": " << Percentile(sorted, 50)
+			<< ", \"p99_ms\": " << Percentile(sorted, 99)
+			<< ", \"max_ms\": " << sorted.back()
+			<< ", \"draw_calls\": " << draw_calls
+			<< ", \"triangles\": " << triangles
+			<< " }" << (i + 1 < results.size() ? "," : "") << "\n";
+
+		std::cout << "Scene " << result.scene << ": mean " << mean << " ms, p50 " << Percentile(sorted, 50) << " ms, p99 " << Percentile(sorted, 99)
+			<< " ms, " << draw_calls << " draw calls, " << triangles << " triangles per frame" << std::endl;
+	}
+
+	file << "  ]\n";
+	file << "}\n";
+
+	if (!file)
+	{
+		std::cout << "Error: Cannot write benchmark report " << settings.report_path << std::endl;
+		return false;
+	}
+	std::cout << "Benchmark report written to " << settings.report_path << std::endl;
+	return true;
+}
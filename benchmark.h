@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+/* Scene Benchmark */
+
+struct BenchmarkSettings
+{
+	int frames = 300;       // measured frames per scene
+	int warmup_frames = 30; // drawn first and not measured, they build shader variants and settle the LOD choice
+	glm::ivec2 resolution = glm::ivec2(960, 960);
+	std::string report_path = "benchmark.json";
+	std::vector<int> scenes = { 1, 2, 3, 4, 5, 6 };
+
+	std::string trace_path; // --profile, also without --headless: the profiler runs and writes a Chrome trace at exit
+	bool vertex_pulling = false; // --pulling, also without --headless: surfaces of revolution are drawn from profile tables
+	bool triangle_strips = false; // --strips, also without --headless: solid meshes are drawn as strips with primitive restart
+	int retune_frames = 0;       // --retune N: the spikes meshes' parameters change every N frames, 0 keeps them fixed
+	int upload_budget_kb = 256;  // --upload-budget KB, also without --headless: mesh bytes streamed to the GPU per frame
+};
+
+// Reads --headless, --frames N, --warmup N, --size WxH, --scenes 1,2,..., --report PATH, --profile PATH, --pulling,
+// --strips, --retune N and --upload-budget KB.
+// Returns whether headless benchmarking was asked for; unknown or malformed options are reported and ignored.
+bool ParseBenchmarkArguments(int argc, char* argv[], BenchmarkSettings& settings);
+
+// Steps through the scenes, warmup and measured frames for each, and collects per-frame costs.
+struct SceneBenchmark
+{
+	struct SceneResult
+	{
+		int scene = 0;
+		std::vector<double> frame_ms;
+		std::vector<int> draw_calls;
+		std::vector<long long> triangles;
+	};
+
+	explicit SceneBenchmark(const BenchmarkSettings& settings);
+
+	bool Running() const;
+	int Scene() const;
+
+	// Animation time of the current frame, advancing at a fixed 60 Hz so every run draws the same frames.
+	double Time() const;
+
+	void BeginFrame();
+
+	// Waits for the GPU to finish the frame, so the measured time covers CPU and GPU work.
+	// Frames only count once fully_loaded_ms is set.
+	void EndFrame(int draw_calls, long long triangles);
+
+	// JSON with mean, p50 and p99 frame times, draw calls and triangles per frame for every scene,
+	// and the startup times below.
+	bool WriteReport(const std::string& renderer) const;
+
+	std::vector<SceneResult> results;
+
+	// since launch, -1 until the first frame is done and until every streamed mesh is resident
+	double first_frame_ms = -1;
+	double fully_loaded_ms = -1;
+
+private:
+	BenchmarkSettings settings;
+	size_t scene_index = 0;
+	int frame = 0; // within the scene, warmup included
+	int total_frames = 0;
+	std::chrono::steady_clock::time_point frame_start;
+};
@@ -0,0 +1,126 @@
+#include "culling.h"
+
+#include <algorithm>
+
+#include "simd_generation.h"
+
+/* Frustum */
+
+Frustum ExtractFrustum(const glm::mat4& clip_from_space)
+{
+	// glm is column major, row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+	const glm::mat4& m = clip_from_space;
+	glm::vec4 row_x(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row_y(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row_z(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row_w(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row_w + row_x; // left
+	frustum.planes[1] = row_w - row_x; // right
+	frustum.planes[2] = row_w + row_y; // bottom
+	frustum.planes[3] = row_w - row_y; // top
+	frustum.planes[4] = row_w + row_z; // near
+	frustum.planes[5] = row_w - row_z; // far
+
+	// normalized planes give distances, which sphere tests need
+	for (glm::vec4& plane : frustum.planes)
+	{
+		float length = glm::length(glm::vec3(plane));
+		if (length > 0)
+			plane /= length;
+	}
+	return frustum;
+}
+
+bool IsSphereVisible(const Frustum& frustum, const glm::vec3& center, float radius)
+{
+	for (const glm::vec4& plane : frustum.planes)
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;
+	return true;
+}
+
+bool IsBoxVisible(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max)
+{
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		// the corner furthest along the plane normal
+		glm::vec3 corner(plane.x >= 0 ? max.x : min.x, plane.y >= 0 ? max.y : min.y, plane.z >= 0 ? max.z : min.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0)
+			return false;
+	}
+	return true;
+}
+
+/* Culling */
+
+bool CullObject(const VAO& vao, const glm::mat4& transform, CullingStatistics& statistics)
+{
+	Frustum frustum = ExtractFrustum(transform);
+
+	bool visible = IsSphereVisible(frustum, vao.bounds.center, vao.bounds.radius)
+		&& IsBoxVisible(frustum, vao.bounds.min, vao.bounds.max);
+
+	if (visible)
+		++statistics.visible;
+	else
+		++statistics.culled;
+	return visible;
+}
+
+void InstanceCuller::SetInstances(const std::vector<glm::vec3>& offsets, const std::vector<glm::vec3>& colors)
+{
+	this->offsets = offsets;
+	this->colors = colors;
+	instances_changed = true;
+
+	// zero padded, the batch test reads whole blocks and ignores the tail
+	size_t padded = (offsets.size() + 7) & ~size_t(7);
+	x.assign(padded, 0.f);
+	y.assign(padded, 0.f);
+	z.assign(padded, 0.f);
+	for (size_t i = 0; i < offsets.size(); ++i)
+	{
+		x[i] = offsets[i].x;
+		y[i] = offsets[i].y;
+		z[i] = offsets[i].z;
+	}
+}
+
+bool InstanceCuller::Cull(
+	const BoundingVolume& bounds,
+	const glm::mat4& transform,
+	std::vector<glm::vec3>& visible_offsets,
+	std::vector<glm::vec3>& visible_colors,
+	CullingStatistics& statistics
+)
+{
+	// every instance is the same sphere moved by its offset, in clip space with w = 1
+	glm::vec3 shared_center = glm::vec3(transform * glm::vec4(bounds.center, 1));
+	float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+	// fold the shared part of the centre into the plane constants so only the offsets are tested
+	Frustum clip = ExtractFrustum(glm::mat4(1.0f));
+	for (glm::vec4& plane : clip.planes)
+		plane.w += glm::dot(glm::vec3(plane), shared_center);
+
+	int count = int(offsets.size());
+	previous_visible.swap(visible);
+	CullSpheresBatch(x.data(), y.data(), z.data(), count, clip.planes, bounds.radius * scale, visible);
+
+	visible_offsets.clear();
+	visible_colors.clear();
+	for (GLuint i : visible)
+	{
+		visible_offsets.push_back(offsets[i]);
+		visible_colors.push_back(colors[i]);
+	}
+
+	statistics.visible += int(visible.size());
+	statistics.culled += count - int(visible.size());
+
+	bool changed = instances_changed || visible != previous_visible;
+	instances_changed = false;
+	return changed;
+}
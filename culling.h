@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include "opengl_utilities.h"
+
+/* Frustum */
+
+// Six normalized planes, a point p is inside where dot(plane, vec4(p, 1)) >= 0 for all of them.
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// Planes of the clip volume pulled back through clip_from_space (Gribb and Hartmann), so they live in
+// the space the matrix maps from. The identity gives the clip cube itself.
+Frustum ExtractFrustum(const glm::mat4& clip_from_space);
+
+bool IsSphereVisible(const Frustum& frustum, const glm::vec3& center, float radius);
+bool IsBoxVisible(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max);
+
+/* Culling */
+
+// Reset once per frame.
+struct CullingStatistics
+{
+	int visible = 0;
+	int culled = 0;
+};
+
+// Tests the VAO bounds in object space against the frustum of transform, sphere first, then box.
+bool CullObject(const VAO& vao, const glm::mat4& transform, CullingStatistics& statistics);
+
+// Instances drawn as offset + transform * position, as in the scene 6 shader.
+// Keeps the offsets in padded structure-of-arrays form for the batched sphere test.
+struct InstanceCuller
+{
+	void SetInstances(const std::vector<glm::vec3>& offsets, const std::vector<glm::vec3>& colors);
+
+	// Fills the visible instances' offsets and colors, in their original order. Returns whether they differ
+	// from those of the previous call, always true after SetInstances, so they are uploaded only when changed.
+	bool Cull(
+		const BoundingVolume& bounds,
+		const glm::mat4& transform,
+		std::vector<glm::vec3>& visible_offsets,
+		std::vector<glm::vec3>& visible_colors,
+		CullingStatistics& statistics
+	);
+
+private:
+	std::vector<glm::vec3> offsets;
+	std::vector<glm::vec3> colors;
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<GLuint> visible;
+	std::vector<GLuint> previous_visible;
+	bool instances_changed = true;
+};
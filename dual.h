@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cmath>
+#include "glm/glm.hpp"
+
+/* Forward-Mode Automatic Differentiation */
+
+// A value carried together with its derivative along one parameter.
+// Evaluating a function on Dual(t, 1) gives f(t) and f'(t) in one pass.
+struct Dual
+{
+	double value;
+	double derivative;
+
+	Dual(double value = 0, double derivative = 0) : value(value), derivative(derivative) {}
+
+	Dual& operator+=(const Dual& b) { derivative += b.derivative; value += b.value; return *this; }
+	Dual& operator-=(const Dual& b) { derivative -= b.derivative; value -= b.value; return *this; }
+	Dual& operator*=(const Dual& b) { derivative = derivative * b.value + value * b.derivative; value *= b.value; return *this; }
+	Dual& operator/=(const Dual& b) { derivative = (derivative * b.value - value * b.derivative) / (b.value * b.value); value /= b.value; return *this; }
+};
+
+inline Dual operator+(Dual a, const Dual& b) { return a += b; }
+inline Dual operator-(Dual a, const Dual& b) { return a -= b; }
+inline Dual operator*(Dual a, const Dual& b) { return a *= b; }
+inline Dual operator/(Dual a, const Dual& b) { return a /= b; }
+inline Dual operator-(const Dual& a) { return Dual(-a.value, -a.derivative); }
+
+inline Dual sin(const Dual& a) { return Dual(std::sin(a.value), std::cos(a.value) * a.derivative); }
+inline Dual cos(const Dual& a) { return Dual(std::cos(a.value), -std::sin(a.value) * a.derivative); }
+inline Dual sqrt(const Dual& a) { double s = std::sqrt(a.value); return Dual(s, a.derivative / (2 * s)); }
+
+struct DualVec2
+{
+	Dual x, y;
+
+	glm::dvec2 Value() const { return glm::dvec2(x.value, y.value); }
+	glm::dvec2 Derivative() const { return glm::dvec2(x.derivative, y.derivative); }
+};
+
+struct DualVec3
+{
+	Dual x, y, z;
+
+	glm::dvec3 Value() const { return glm::dvec3(x.value, y.value, z.value); }
+	glm::dvec3 Derivative() const { return glm::dvec3(x.derivative, y.derivative, z.derivative); }
+};
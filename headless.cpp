@@ -0,0 +1,137 @@
+#include "headless.h"
+
+#include <iostream>
+
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+/* Headless Rendering */
+
+#ifndef _WIN32
+
+HeadlessContext::~HeadlessContext()
+{
+	if (!display)
+		return;
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context)
+		eglDestroyContext(display, context);
+	eglTerminate(display);
+}
+
+bool HeadlessContext::Create()
+{
+	// the surfaceless platform needs neither X nor Wayland, other drivers fall back to their default display
+	EGLDisplay egl_display = EGL_NO_DISPLAY;
+	auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	if (get_platform_display)
+		egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (egl_display == EGL_NO_DISPLAY)
+		egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, nullptr, nullptr))
+	{
+		std::cout << "Error: No EGL display" << std::endl;
+		return false;
+	}
+	display = egl_display;
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cout << "Error: EGL has no desktop OpenGL" << std::endl;
+		return false;
+	}
+
+	const EGLint config_attributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint config_count = 0;
+	if (!eglChooseConfig(egl_display, config_attributes, &config, 1, &config_count) || config_count < 1)
+	{
+		std::cout << "Error: No EGL config for OpenGL" << std::endl;
+		return false;
+	}
+
+	// the same version and profile the window asks GLFW for
+	const EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attributes);
+	if (egl_context == EGL_NO_CONTEXT)
+	{
+		std::cout << "Error: Cannot create an OpenGL 3.3 core context with EGL" << std::endl;
+		return false;
+	}
+	context = egl_context;
+
+	// no surface at all, drawing goes to the framebuffer object (EGL_KHR_surfaceless_context)
+	if (!eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context))
+	{
+		std::cout << "Error: EGL cannot make a context current without a surface" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void* HeadlessContext::GetProcAddress(const char* name)
+{
+	return reinterpret_cast<void*>(eglGetProcAddress(name));
+}
+
+#else
+
+HeadlessContext::~HeadlessContext()
+{
+}
+
+bool HeadlessContext::Create()
+{
+	std::cout << "Error: Headless rendering needs EGL, which this platform lacks" << std::endl;
+	return false;
+}
+
+void* HeadlessContext::GetProcAddress(const char*)
+{
+	return nullptr;
+}
+
+#endif
+
+bool HeadlessContext::CreateFramebuffer(const glm::ivec2& size)
+{
+	glGenRenderbuffers(1, &color_buffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.x, size.y);
+
+	glGenRenderbuffers(1, &depth_buffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.x, size.y);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Error: Offscreen framebuffer is incomplete" << std::endl;
+		return false;
+	}
+
+	// a context without a surface starts with an empty viewport
+	glViewport(0, 0, size.x, size.y);
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+/* Headless Rendering */
+
+// An OpenGL 3.3 core context with no window and no display server, rendering into a framebuffer object.
+// Uses EGL, preferring Mesa's surfaceless platform so it also runs on llvmpipe where there is no GPU.
+struct HeadlessContext
+{
+	HeadlessContext() = default;
+	~HeadlessContext();
+
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+	// Creates the context and makes it current. False, with the reason printed, when EGL cannot provide one.
+	bool Create();
+
+	// Resolves GL entry points for gladLoadGLLoader and the extension loaders.
+	static void* GetProcAddress(const char* name);
+
+	// Color and depth renderbuffers of size, bound as the draw framebuffer with a matching viewport.
+	// Needs the GL functions loaded.
+	bool CreateFramebuffer(const glm::ivec2& size);
+
+	GLuint framebuffer = 0;
+	GLuint color_buffer = 0;
+	GLuint depth_buffer = 0;
+
+private:
+	void* display = nullptr;
+	void* context = nullptr;
+};
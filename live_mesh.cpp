@@ -0,0 +1,154 @@
+#include "live_mesh.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "mesh_optimization.h"
+#include "profiler.h"
+
+/* Shape Parameters */
+
+bool ShapeParameters::operator==(const ShapeParameters& other) const
+{
+	return spikes == other.spikes && frequency == other.frequency && segments == other.segments;
+}
+
+/* Live Meshes */
+
+LiveMesh::LiveMesh(const ParameterizedGenerator& generate, const ParameterizedCurves& curves, const std::vector<int>& level_segments,
+	VertexLayout layout, GeometryArena* arena)
+	: swaps(0), generation_ms(0), generate(generate), curves(curves), level_segments(level_segments), layout(layout), arena(arena),
+	  front(0), any_request(false), has_request(false), stopping(false)
+{
+	chain.bounding_radius = 0;
+	worker = std::thread(&LiveMesh::WorkerLoop, this);
+}
+
+LiveMesh::~LiveMesh()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+void LiveMesh::Request(const ShapeParameters& parameters)
+{
+	if (any_request && parameters == latest)
+		return;
+	latest = parameters;
+	any_request = true;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requested = parameters;
+		has_request = true;
+	}
+	wake.notify_one();
+}
+
+void LiveMesh::WorkerLoop()
+{
+	SetProfilerThreadName("Live mesh");
+
+	for (;;)
+	{
+		ShapeParameters job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return has_request || stopping; });
+			if (stopping)
+				return;
+			job = requested;
+			has_request = false;
+		}
+
+		PROFILE_ZONE("Regenerate live mesh");
+		auto start = std::chrono::steady_clock::now();
+
+		std::unique_ptr<Result> result(new Result());
+		result->parameters = job;
+		std::vector<int> segments;
+		for (int base : level_segments)
+		{
+			// coarser levels keep their ratio to the finest, and at least a few segments
+			Level level;
+			level.segments = std::max(4, base * job.segments / level_segments[0]);
+			generate(job, level.positions, level.normals, level.indices, level.segments, level.segments);
+			OptimizeMesh(level.positions, level.normals, level.indices, nullptr);
+			level.edges = GenerateEdgeIndices(level.indices.data(), level.indices.size());
+			if (arena)
+				level.packed = PackMesh(layout, level.positions.data(), level.normals.data(), GLsizei(level.positions.size()),
+					level.indices.data(), GLsizei(level.indices.size()), level.packed_vertices, level.packed_elements, &level.edges);
+			segments.push_back(level.segments);
+			result->levels.push_back(std::move(level));
+		}
+
+		Curve2D profile, ring;
+		curves(job, profile, ring);
+		result->error_constant = ChordErrorConstant(segments, profile, ring);
+
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		result->milliseconds = elapsed.count();
+
+		// an unclaimed older chain is simply replaced
+		std::lock_guard<std::mutex> lock(mutex);
+		finished = std::move(result);
+	}
+}
+
+bool LiveMesh::Update()
+{
+	std::unique_ptr<Result> result;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		result = std::move(finished);
+	}
+	if (!result)
+		return false;
+
+	PROFILE_ZONE("Swap live mesh");
+
+	// the set drawn until the last swap is written, the GPU may still read it but orphaning keeps that from waiting;
+	// in the arena its ranges are freed and reused, and the writes are ordered after the draws that read them
+	int back = 1 - front;
+	std::vector<std::unique_ptr<VAO>>& set = sets[back];
+	set.resize(result->levels.size());
+
+	LodChain swapped;
+	swapped.bounding_radius = 0;
+	swapped.error_constant = result->error_constant;
+	for (size_t i = 0; i < result->levels.size(); ++i)
+	{
+		const Level& level = result->levels[i];
+		GLsizei vertex_count = GLsizei(level.positions.size());
+		GLsizei index_count = GLsizei(level.indices.size());
+		if (set[i] && set[i]->arena)
+			set[i]->arena->Free(*set[i]);
+		std::unique_ptr<VAO> allocated = arena ? arena->Allocate(level.packed) : nullptr;
+		if (allocated)
+			set[i] = std::move(allocated);
+		else
+		{
+			// a new set starts empty so even its first fill takes the edges found in the background
+			if (!set[i] || set[i]->id == 0)
+				set[i].reset(new VAO(nullptr, nullptr, 0, nullptr, 0, layout));
+			set[i]->Refill(level.positions.data(), level.normals.data(), vertex_count, level.indices.data(), index_count, &level.edges);
+		}
+
+		VAO& vao = *set[i];
+		swapped.levels.push_back(&vao);
+		swapped.segments.push_back(level.segments);
+		swapped.bounding_radius = std::max(swapped.bounding_radius, glm::length(vao.bounds.center) + vao.bounds.radius);
+	}
+
+	front = back;
+	chain = swapped;
+	parameters = result->parameters;
+	positions = std::move(result->levels[0].positions);
+	generation_ms = result->milliseconds;
+	++swaps;
+	return true;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include "lod.h"
+#include "opengl_utilities.h"
+
+/* Shape Parameters */
+
+// The constants of the spikes meshes, changeable while the scenes run.
+struct ShapeParameters
+{
+	int spikes = 2 + 4 * 2; // spikes around the profile, as in ParametricSpikes
+	float frequency = 6;    // waves per turn of the modulated surface, as in GenerateParametricShapeFrom2D_2
+	int segments = 100;     // vertical and rotation segments of the finest level
+
+	bool operator==(const ShapeParameters& other) const;
+	bool operator!=(const ShapeParameters& other) const { return !(*this == other); }
+};
+
+typedef std::function<void(const ShapeParameters&, std::vector<glm::vec3>&, std::vector<glm::vec3>&, std::vector<GLuint>&, int, int)> ParameterizedGenerator;
+
+// Sets the profile and ring of the surface generated for the parameters, see ChordErrorConstant.
+typedef std::function<void(const ShapeParameters&, Curve2D&, Curve2D&)> ParameterizedCurves;
+
+/* Live Meshes */
+
+// A LodChain regenerated whenever its parameters change, without stalling the thread that draws it.
+// A background thread generates, welds and optimizes every level; Update, called once per frame on the GL
+// thread, refills the spare set of VAOs with the finished levels and swaps the two sets, so the set being
+// drawn is never written. With an arena the spare set's ranges are freed and the new levels allocated there,
+// so the chain is drawn together with the arena's other meshes; levels too large for it get VAOs of their own. Requests made while a chain is being generated replace each other, only the newest
+// is generated next, so parameters changing every frame keep one generation in flight at a time.
+struct LiveMesh
+{
+	// Levels follow level_segments, finest first, scaled so the finest has parameters.segments.
+	// generate(parameters, positions, normals, indices, vertical, rotation) runs on the background thread, as does
+	// curves, which gives the chain its error constant. An arena must have the same layout.
+	LiveMesh(const ParameterizedGenerator& generate, const ParameterizedCurves& curves, const std::vector<int>& level_segments,
+		VertexLayout layout = VERTEX_LAYOUT_COMPACT, GeometryArena* arena = nullptr);
+	~LiveMesh();
+
+	LiveMesh(const LiveMesh&) = delete;
+	LiveMesh& operator=(const LiveMesh&) = delete;
+
+	// Asks for a chain with these parameters, ignored when they are the ones drawn or already asked for.
+	void Request(const ShapeParameters& parameters);
+
+	// Swaps in the newest finished chain, if any. Returns whether the chain changed.
+	bool Update();
+
+	// False until the first requested chain has been swapped in.
+	bool HasChain() const { return swaps > 0; }
+
+	const LodChain& Chain() const { return chain; }
+	const ShapeParameters& Parameters() const { return parameters; }
+
+	// The finest level of the chain drawn, as generated and optimized.
+	const std::vector<glm::vec3>& Positions() const { return positions; }
+
+	int swaps;            // chains swapped in so far
+	double generation_ms; // background time of the chain drawn, generation and optimization of every level
+
+private:
+	struct Level
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<GLuint> indices;
+		std::vector<GLuint> edges;
+		int segments;
+
+		// for the arena, packed on the background thread
+		PackedMesh packed;
+		std::vector<unsigned char> packed_vertices;
+		std::vector<unsigned char> packed_elements;
+	};
+
+	struct Result
+	{
+		ShapeParameters parameters;
+		std::vector<Level> levels;
+		float error_constant;
+		double milliseconds;
+	};
+
+	void WorkerLoop();
+
+	ParameterizedGenerator generate;
+	ParameterizedCurves curves;
+	std::vector<int> level_segments;
+	VertexLayout layout;
+	GeometryArena* arena;
+
+	// two sets of level meshes, the chain points into sets[front]
+	std::vector<std::unique_ptr<VAO>> sets[2];
+	int front;
+	LodChain chain;
+	ShapeParameters parameters;
+	std::vector<glm::vec3> positions;
+	ShapeParameters latest; // last request, on the calling thread
+	bool any_request;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake;
+	ShapeParameters requested; // generated next while has_request is set
+	bool has_request;
+	std::unique_ptr<Result> finished;
+	bool stopping;
+};
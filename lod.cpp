@@ -0,0 +1,205 @@
+#include "lod.h"
+
+#include <algorithm>
+#include <cmath>
+#include "glm/gtc/constants.hpp"
+
+#include "mesh_streaming.h"
+
+/* Level Of Detail */
+
+double ChordError(const Curve2D& curve, int steps)
+{
+	double error = 0;
+	for (int i = 0; i < steps; ++i)
+	{
+		double t0 = i / double(steps);
+		double t1 = (i + 1) / double(steps);
+		glm::dvec2 a = curve(t0);
+		glm::dvec2 chord = curve(t1) - a;
+		double length = glm::length(chord);
+
+		// the curve at the eighth points against the chord, as ChordFitsCurve measures
+		for (int k = 1; k < 8; ++k)
+		{
+			glm::dvec2 offset = curve(t0 + (t1 - t0) * k / 8) - a;
+			double distance = length > 0 ? std::abs(offset.x * chord.y - offset.y * chord.x) / length : glm::length(offset);
+			error = std::max(error, distance);
+		}
+	}
+	return error;
+}
+
+Curve2D RevolutionRing(const Curve2D& profile, double frequency)
+{
+	double radius = 0;
+	for (int i = 0; i <= 1024; ++i)
+		radius = std::max(radius, std::abs(profile(i / 1024.0).x));
+
+	return [radius, frequency](double r) {
+		double angle = r * glm::two_pi<double>();
+		double scale = frequency > 0 ? (std::sin(angle * frequency) / 2 + 1) * 0.5 : 1;
+		return glm::dvec2(std::cos(angle), std::sin(angle)) * radius * scale;
+	};
+}
+
+float ChordErrorConstant(const std::vector<int>& segments, const Curve2D& profile, const Curve2D& ring)
+{
+	// profiles are sampled at both ends, rings close on themselves
+	double constant = 0;
+	for (int count : segments)
+	{
+		double error = std::max(ChordError(profile, std::max(count - 1, 1)), ChordError(ring, count));
+		constant = std::max(constant, error * count * count);
+	}
+	return float(constant);
+}
+
+float LodChain::RequiredSegments(const glm::mat4& transform, const glm::ivec2& viewport, float pixel_error) const
+{
+	// largest axis scale of the transform, the bounding sphere grows by at most that much
+	float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+	float w = (transform * glm::vec4(0, 0, 0, 1)).w;
+	if (w <= 1e-6f)
+		return float(segments.front());
+
+	float pixels_per_unit = scale / w * 0.5f * float(std::max(viewport.x, viewport.y));
+
+	// a circle of radius r drawn with n chords deviates from the arc by r (1 - cos(pi / n)), about r pi² / 2n²
+	float constant = error_constant > 0 ? error_constant : bounding_radius * glm::pi<float>() * glm::pi<float>() / 2;
+	return std::max(3.0f, std::sqrt(constant * pixels_per_unit / pixel_error));
+}
+
+int LodChain::SelectLevel(const glm::mat4& transform, const glm::ivec2& viewport, float pixel_error) const
+{
+	float required = RequiredSegments(transform, viewport, pixel_error);
+
+	int level = 0;
+	while (level + 1 < int(levels.size()) && segments[level + 1] >= required)
+		++level;
+	return level;
+}
+
+int LodChain::Select(LodState& state, const glm::mat4& transform, const glm::ivec2& viewport, double time, const LodSettings& settings, LodDraw draws[2]) const
+{
+	float required = RequiredSegments(transform, viewport, settings.pixel_error);
+
+	int level = state.level < 0 ? 0 : state.level;
+
+	// refine as soon as the current level is too coarse, coarsen only with a margin to spare
+	while (level > 0 && segments[level] < required)
+		--level;
+	while (level + 1 < int(levels.size()) && segments[level + 1] >= required * (1 + settings.hysteresis))
+		++level;
+
+	if (!levels[level]->resident)
+	{
+		int wanted = level;
+		level = -1;
+		for (int coarser = wanted + 1; coarser < int(levels.size()) && level < 0; ++coarser)
+			if (levels[coarser]->resident)
+				level = coarser;
+		for (int finer = wanted - 1; finer >= 0 && level < 0; --finer)
+			if (levels[finer]->resident)
+				level = finer;
+		if (level < 0)
+			return 0;
+	}
+
+	if (state.level < 0)
+		state.level = level;
+	else if (level != state.level)
+	{
+		state.previous_level = settings.fade_seconds > 0 ? state.level : -1;
+		state.level = level;
+		state.fade_start = time;
+	}
+
+	float fade = 1;
+	if (state.previous_level >= 0)
+	{
+		fade = float((time - state.fade_start) / settings.fade_seconds);
+		if (fade >= 1)
+			state.previous_level = -1;
+	}
+
+	if (state.previous_level < 0)
+	{
+		draws[0] = LodDraw{ levels[state.level], 0 };
+		return 1;
+	}
+
+	fade = std::max(fade, 1e-3f);
+	draws[0] = LodDraw{ levels[state.level], fade };
+	draws[1] = LodDraw{ levels[state.previous_level], -fade };
+	return 2;
+}
+
+void LodChain::UpdateBoundingRadius()
+{
+	// the chain measures from the origin, widen each level's sphere to be centred there
+	bounding_radius = 0;
+	for (const VAO* level : levels)
+		if (level->resident)
+			bounding_radius = std::max(bounding_radius, glm::length(level->bounds.center) + level->bounds.radius);
+}
+
+LodChain BuildLodChain(MeshRegistry& meshes, const MeshKey& key, const std::vector<int>& segment_counts, const SegmentedGenerator& generate)
+{
+	LodChain chain;
+
+	for (int count : segment_counts)
+	{
+		MeshKey level_key = key;
+		level_key.vertical_segments = count;
+		level_key.rotation_segments = count;
+
+		chain.levels.push_back(&meshes.Get(level_key, [&](std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices) {
+			generate(positions, normals, indices, count, count);
+		}));
+		chain.segments.push_back(count);
+	}
+
+	chain.UpdateBoundingRadius();
+	return chain;
+}
+
+LodChain BuildStreamedLodChain(MeshStreamer& streamer, const MeshKey& key, const std::vector<int>& segment_counts, const SegmentedGenerator& generate)
+{
+	LodChain chain;
+	chain.levels.resize(segment_counts.size());
+	chain.segments = segment_counts;
+
+	for (int i = int(segment_counts.size()) - 1; i >= 0; --i)
+	{
+		int count = segment_counts[i];
+		MeshKey level_key = key;
+		level_key.vertical_segments = count;
+		level_key.rotation_segments = count;
+
+		chain.levels[i] = &streamer.Request(level_key, [generate, count](std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices) {
+			generate(positions, normals, indices, count, count);
+		});
+	}
+
+	chain.UpdateBoundingRadius();
+	return chain;
+}
+
+LodChain BuildPulledLodChain(ProfileTable& table, const std::vector<int>& segment_counts, const ProfileSampler& sample)
+{
+	LodChain chain;
+
+	std::vector<glm::vec2> positions;
+	std::vector<glm::vec2> normals;
+	for (int count : segment_counts)
+	{
+		sample(positions, normals, count);
+		chain.levels.push_back(&table.Add(positions.data(), normals.data(), GLsizei(positions.size()), count));
+		chain.segments.push_back(count);
+	}
+
+	chain.UpdateBoundingRadius();
+	return chain;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include "mesh_cache.h"
+#include "opengl_utilities.h"
+
+struct MeshStreamer;
+
+/* Level Of Detail */
+
+struct LodSettings
+{
+	float pixel_error = 1.0f;   // largest allowed gap in pixels between the true surface and a level's facets
+	float hysteresis = 0.15f;   // a coarser level is taken only once it has this fraction of segments to spare
+	float fade_seconds = 0.25f; // length of the dithered cross-fade between two levels, 0 switches at once
+};
+
+// Per drawn object: the level on screen and the one fading out.
+struct LodState
+{
+	int level = -1;
+	int previous_level = -1;
+	double fade_start = 0;
+};
+
+// One draw of a level. fade is 0 outside transitions, f in (0, 1) for the incoming level and -f for
+// the outgoing one; shaders keep complementary dither patterns so the two never overlap.
+struct LodDraw
+{
+	VAO* vao;
+	float fade;
+};
+
+typedef std::function<glm::dvec2(double)> Curve2D;
+
+// Largest distance between curve, over t in [0, 1], and its chords when t is cut into steps equal parts.
+double ChordError(const Curve2D& curve, int steps);
+
+// The ring swept around Y by the profile point furthest from the axis, where the chords around the axis are longest.
+// A frequency gives the widest ring of a ModulatedRevolvedSurface of that frequency instead.
+Curve2D RevolutionRing(const Curve2D& profile, double frequency = 0);
+
+// Chord error constant of a surface whose columns follow profile and whose rows follow ring, as generated with
+// n vertical and n rotation segments for every n in segments: a level of n segments stays within constant / n²
+// object units. The worst level sets it, as sharply bent profiles lose less than 1 / n² at coarse levels.
+float ChordErrorConstant(const std::vector<int>& segments, const Curve2D& profile, const Curve2D& ring);
+
+// The same parametric shape at decreasing segment counts, all centred on the origin.
+struct LodChain
+{
+	std::vector<VAO*> levels; // finest first
+	std::vector<int> segments; // segments around the coarsest direction of each level
+	float bounding_radius;
+	float error_constant = 0; // from ChordErrorConstant, 0 treats the chain as a sphere of bounding_radius
+
+	// Widest sphere around the origin over the resident levels, again whenever more of them become resident.
+	void UpdateBoundingRadius();
+
+	// Segments the chain's surface needs under transform so its facets stay within pixel_error.
+	float RequiredSegments(const glm::mat4& transform, const glm::ivec2& viewport, float pixel_error) const;
+
+	// Coarsest level meeting the pixel error, ignoring any previous choice.
+	int SelectLevel(const glm::mat4& transform, const glm::ivec2& viewport, float pixel_error) const;
+
+	// Updates state with hysteresis and returns the draws for this frame, one or two while cross-fading.
+	// A level that is not resident yet is stood in for by the nearest resident one, coarser first, and the
+	// chain fades to the chosen level once it arrives. Returns 0 while no level is resident.
+	int Select(LodState& state, const glm::mat4& transform, const glm::ivec2& viewport, double time, const LodSettings& settings, LodDraw draws[2]) const;
+};
+
+typedef std::function<void(std::vector<glm::vec3>&, std::vector<glm::vec3>&, std::vector<GLuint>&, int, int)> SegmentedGenerator;
+
+// Registers key at every segment count, finest first, with generate(positions, normals, indices, vertical, rotation).
+// Each level is a separate registry key, so levels are cached and shared like any other mesh.
+LodChain BuildLodChain(MeshRegistry& meshes, const MeshKey& key, const std::vector<int>& segment_counts, const SegmentedGenerator& generate);
+
+// The same chain with every level requested from a MeshStreamer, coarsest first so something is drawn soonest.
+// The levels are not resident yet, update the bounding radius as they arrive.
+LodChain BuildStreamedLodChain(MeshStreamer& streamer, const MeshKey& key, const std::vector<int>& segment_counts, const SegmentedGenerator& generate);
+
+typedef std::function<void(std::vector<glm::vec2>&, std::vector<glm::vec2>&, int)> ProfileSampler;
+
+// The same chain for a surface of revolution pulled from a ProfileTable: sample(positions, normals, vertical)
+// gives each level's profile, which the level rotates as many times. Upload the table before drawing.
+LodChain BuildPulledLodChain(ProfileTable& table, const std::vector<int>& segment_counts, const ProfileSampler& sample);
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <iostream>
 #include <vector>
 
@@ -8,18 +9,97 @@
 #include "GLFW/glfw3.h"
 
 #include "opengl_utilities.h"
+#include "benchmark.h"
+#include "profiler.h"
+#include "headless.h"
+#include "program_cache.h"
+#include "shader_permutations.h"
+#include "culling.h"
+#include "lod.h"
+#include "live_mesh.h"
+#include "render_queue.h"
+#include "mesh_cache.h"
+#include "mesh_streaming.h"
 #include "mesh_generation.h"
+#include "simd_generation.h"
 
 /* Keep the global state inside this struct */
 static struct {
 	glm::dvec2 mouse_position;
 	glm::ivec2 screen_dimensions = glm::ivec2(960, 960);
     GLuint scene;
-    GLuint program;
+    Program* program;
     glm::dvec3 shape_color= glm::dvec3(1.,1.,1.);
     GLuint shininess=32;
+    ShapeParameters shape; // of the spikes meshes, tuned with the bracket, minus/equal and comma/period keys
 } Globals;
 
+/* Uniform Blocks */
+
+// std140 mirrors of the Frame and Objects blocks in the shaders
+struct FrameUniforms
+{
+	glm::vec4 ambient_color;
+	glm::vec4 light_direction;
+	glm::vec4 light_color;
+	glm::vec4 point_light_color;
+	glm::vec2 mouse_position;
+	float time;
+	float padding;
+};
+
+struct ObjectUniforms
+{
+	glm::mat4 transform;
+	glm::vec4 color;
+	glm::vec4 material; // x: shininess
+};
+
+enum UniformBinding
+{
+	FRAME_BINDING = 0,
+	OBJECTS_BINDING = 1
+};
+
+// entries of the Objects block, one per drawn object across all scenes
+enum SceneObject
+{
+	OBJECT_SPHERE,
+	OBJECT_CHASING_SPHERE,
+	OBJECT_MOUSE_SPHERE,
+	OBJECT_TORUS_CLOUD,
+	OBJECT_TORUS,
+	OBJECT_SPIKES_TORUS,
+	OBJECT_SPIKES,
+	OBJECT_COUNT
+};
+
+const int max_objects = 64; // length of object_data in the shaders
+
+/* Shader Features */
+
+// bit i of a permutation key defines the i-th name passed to ShaderPermutations
+enum ShaderFeature
+{
+	SHADER_LIT = 1 << 0,             // ambient, directional and specular lighting, flat white without it
+	SHADER_NORMAL_COLOR = 1 << 1,    // normals as colour when not lit
+	SHADER_POINT_LIGHT = 1 << 2,     // a point light at the mouse
+	SHADER_OBJECT_MATERIAL = 1 << 3, // colour and shininess from the object entry, gray and 64 without it
+	SHADER_INSTANCED = 1 << 4,       // per-instance offset and colour attributes
+	SHADER_PULLED = 1 << 5           // positions and normals rebuilt from a ProfileTable, no vertex buffers
+};
+
+// permutation drawn by each scene, scene 0 draws with no program
+static const unsigned scene_shaders[7] = {
+	0,
+	0,                                                        // wireframe
+	SHADER_NORMAL_COLOR,                                      // normals
+	SHADER_LIT,                                               // gray, directional light
+	SHADER_LIT | SHADER_POINT_LIGHT | SHADER_OBJECT_MATERIAL, // coloured, mouse light
+	SHADER_LIT | SHADER_POINT_LIGHT | SHADER_OBJECT_MATERIAL, // chasing spheres
+	SHADER_LIT | SHADER_INSTANCED                             // torus cloud
+};
+
 /* GLFW Callback functions */
 static void ErrorCallback(int error, const char* description)
 {
@@ -66,653 +146,829 @@ static void KeyCallback(GLFWwindow *window, int key, int scancode, int action, i
         else if (key== 89) {
             Globals.scene = 6;
         }
+        // [ and ], spikes of the spikes profile
+        else if (key== 91 || key== 93) {
+            if (action != GLFW_RELEASE)
+                Globals.shape.spikes = glm::clamp(Globals.shape.spikes + (key== 93 ? 1 : -1), 2, 32);
+        }
+        // - and =, waves of the spikes mesh
+        else if (key== 45 || key== 61) {
+            if (action != GLFW_RELEASE)
+                Globals.shape.frequency = glm::clamp(Globals.shape.frequency + (key== 61 ? 1.f : -1.f), 0.f, 16.f);
+        }
+        // , and ., segments of both spikes meshes
+        else if (key== 44 || key== 46) {
+            if (action != GLFW_RELEASE)
+                Globals.shape.segments = glm::clamp(Globals.shape.segments + (key== 46 ? 10 : -10), 20, 250);
+        }
         else{
             Globals.scene = 0;
         }
 }
 
+/* Level Of Detail Drawing */
 
+// Skips the draws when the object's bounds are outside the frustum of transform, when no level is resident yet,
+// or when the program is not built.
+static void DrawLevels(RenderQueue& queue, const LodDraw* draws, int draw_count, GLenum mode, Program& program, SceneObject object, const glm::mat4& transform, CullingStatistics& culling)
+{
+    if (draw_count == 0 || program.id == 0 || !CullObject(*draws[0].vao, transform, culling))
+        return;
 
-int main(int argc, char* argv[])
+    for (int i = 0; i < draw_count; ++i)
+        queue.Submit({ &program, draws[i].vao, mode, object, draws[i].fade, false });
+}
+
+// Draws the instances each level currently holds, culled beforehand by an InstanceCuller.
+static void DrawInstancedLevels(RenderQueue& queue, const LodDraw* draws, int draw_count, GLenum mode, Program& program, SceneObject object)
 {
-	/* Set GLFW error callback */
-	glfwSetErrorCallback(ErrorCallback);
+    for (int i = 0; i < draw_count; ++i) {
+        if (draws[i].vao->instance_count == 0 || program.id == 0)
+            continue;
+        queue.Submit({ &program, draws[i].vao, mode, object, draws[i].fade, true });
+    }
+}
+
+// The profile of shape as a curve for ChordErrorConstant, evaluated as the SIMD generators evaluate it, times scale.
+static Curve2D ShapeProfileCurve(const ProfileShape& shape, double scale = 1)
+{
+    return [shape, scale](double t) {
+        float parameter = float(t), x, y, dx, dy;
+        EvaluateProfileBatch(shape, &parameter, &x, &y, &dx, &dy, 1);
+        return glm::dvec2(x, y) * scale;
+    };
+}
+
+// Creates the scenes and draws them until the window closes or the benchmark ends. Every GL object is owned
+// here, so they are all deleted while the context is still current.
+static int RunScenes(GLFWwindow* window, GLADloadproc load, bool headless, const BenchmarkSettings& benchmark_settings,
+                     std::chrono::steady_clock::time_point startup_start);
 
-	/* Initialize the library */
-	if (!glfwInit())
+int main(int argc, char* argv[])
+{
+	auto startup_start = std::chrono::steady_clock::now();
+
+	/* Headless Benchmark */
+	// --headless renders every scene offscreen for a fixed number of frames and writes a report instead of opening a window
+	BenchmarkSettings benchmark_settings;
+	bool headless = ParseBenchmarkArguments(argc, argv, benchmark_settings);
+	EnableProfiler(!benchmark_settings.trace_path.empty());
+	SetProfilerThreadName("Main");
+	HeadlessContext headless_context;
+	GLFWwindow* window = NULL;
+	GLADloadproc load = (GLADloadproc)glfwGetProcAddress;
+
+	if (headless)
 	{
-		std::cout << "Failed to initialize GLFW" << std::endl;
-		return -1;
+		PROFILE_ZONE("EGL init");
+		Globals.screen_dimensions = benchmark_settings.resolution;
+		if (!headless_context.Create())
+			return -1;
+		load = HeadlessContext::GetProcAddress;
 	}
-
-	/* Create a windowed mode window and its OpenGL context */
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-	GLFWwindow* window = glfwCreateWindow(
-		Globals.screen_dimensions.x, Globals.screen_dimensions.y,
-		"Begum Celik", NULL, NULL
-	);
-	if (!window)
+	else
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return -1;
+		PROFILE_ZONE("GLFW init");
+
+		/* Set GLFW error callback */
+		glfwSetErrorCallback(ErrorCallback);
+
+		/* Initialize the library */
+		if (!glfwInit())
+		{
+			std::cout << "Failed to initialize GLFW" << std::endl;
+			return -1;
+		}
+
+		/* Create a windowed mode window and its OpenGL context */
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+		window = glfwCreateWindow(
+			Globals.screen_dimensions.x, Globals.screen_dimensions.y,
+			"Begum Celik", NULL, NULL
+		);
+		if (!window)
+		{
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		/* Move window to a certain position [do not change] */
+		glfwSetWindowPos(window, 10, 50);
+		/* Make the window's context current */
+		glfwMakeContextCurrent(window);
+		/* Enable VSync */
+		glfwSwapInterval(1);
+		/* Enable Keyboard Control */
+		glfwSetKeyCallback(window, KeyCallback);
 	}
-	/* Move window to a certain position [do not change] */
-	glfwSetWindowPos(window, 10, 50);
-	/* Make the window's context current */
-	glfwMakeContextCurrent(window);
-	/* Enable VSync */
-	glfwSwapInterval(1);
-    /* Enable Keyboard Control */
-    glfwSetKeyCallback(window, KeyCallback);
     
 	/* Load OpenGL extensions with GLAD */
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	bool loaded;
+	{
+		PROFILE_ZONE("GLAD load");
+		loaded = gladLoadGLLoader(load);
+	}
+	if (!loaded)
 	{
 		std::cout << "Failed to initialize GLAD" << std::endl;
-		glfwTerminate();
+		if (!headless)
+			glfwTerminate();
 		return -1;
 	}
     
-	/* Set GLFW Callbacks */
-	glfwSetCursorPosCallback(window, CursorPositionCallback);
-	glfwSetWindowSizeCallback(window, WindowSizeCallback); // for resizable content
+	if (headless)
+	{
+		// vsync does not apply, frames go to a framebuffer object and are never presented
+		if (!headless_context.CreateFramebuffer(Globals.screen_dimensions))
+			return -1;
+	}
+	else
+	{
+		/* Set GLFW Callbacks */
+		glfwSetCursorPosCallback(window, CursorPositionCallback);
+		glfwSetWindowSizeCallback(window, WindowSizeCallback); // for resizable content
+	}
 
 	/* Configure OpenGL */
 	glClearColor(0, 0, 0, 1);
 	glEnable(GL_DEPTH_TEST);
 
-	/* Creating Meshes */
-    
-    // Sphere Mesh
-    std::vector<glm::vec3> positions;
-    std::vector<glm::vec3> normals;
-    std::vector<GLuint> indices;
-    int vertical_segment =16, rotation_segment=16;
-    
-    GenerateParametricShapeFrom2D(positions, normals, indices, ParametricHalfCircle, vertical_segment, rotation_segment);
-    VAO sphereVAO(positions, normals, indices);
-    
-    // Torus Mesh
-    positions.clear();
-    normals.clear();
-    indices.clear();
-    
-    GenerateParametricShapeFrom2D(positions, normals, indices, ParametricCircle, vertical_segment, rotation_segment);
-    VAO torusVAO(positions, normals, indices);
-    
-    // Spikes Torus Mesh
-    positions.clear();
-    normals.clear();
-    indices.clear();
-    
-    GenerateParametricShapeFrom2D(positions, normals, indices, ParametricSpikes, 100, 100);
-    VAO spikestorusVAO(positions, normals, indices);
-    
-    // Spikes Mesh
-    positions.clear();
-    normals.clear();
-    indices.clear();
-    
-    GenerateParametricShapeFrom2D_2(positions, normals, indices, ParametricSpikes, 100, 100);
-    VAO spikesVAO(positions, normals, indices);
-
-	/* Creating Programs */
-	GLuint program1 = CreateProgramFromSources(
-		R"VERTEX(
-            #version 330 core
-
-            layout(location = 0) in vec3 a_position;
-                                               
-            uniform mat4 u_transform;
-                                               
-            void main()
-            {
-                gl_Position = u_transform *  vec4(a_position, 1);
-            }
-		)VERTEX",
+	int result = RunScenes(window, load, headless, benchmark_settings, startup_start);
 
-		R"FRAGMENT(
-            #version 330 core
-            
-            
-            out vec4 out_color;
+	if (!headless)
+		glfwTerminate();
+	return result;
+}
 
-            void main()
-            {
-                out_color = vec4(1,1,1,1); // color of wireframe
-            }
-		)FRAGMENT");
+static int RunScenes(GLFWwindow* window, GLADloadproc load, bool headless, const BenchmarkSettings& benchmark_settings,
+                     std::chrono::steady_clock::time_point startup_start)
+{
+	/* Creating Programs */
+    // one source for every scene, specialised by feature bits; a variant is built the first time a scene draws
+    // with it, and built variants are kept in the binary cache for later launches
+    bool parallel_compile = EnableParallelShaderCompile(load);
+    SetProgramBinaryCache("shader_cache", load);
     
-    GLuint program2 = CreateProgramFromSources(
+    ShaderPermutations shaders(
+        "#version 330 core",
         R"VERTEX(
-            #version 330 core
-
+        #ifdef SHADER_PULLED
+            // the mesh's profile texels and grid, see ProfileTable
+            uniform samplerBuffer profile_table;
+            uniform ivec4 profile_shape; // x: first texel, y: profile samples, z: rotation segments, w: 1 for edges
+        #else
             layout(location = 0) in vec3 a_position;
             layout(location = 1) in vec3 a_normal;
-                                               
-            uniform mat4 u_transform;
-
-
-            out vec3 vertex_position;
-            out vec3 vertex_normal;
-            void main()
+        #endif
+            layout(location = 4) in vec2 a_draw; // x: object entry, y: level-of-detail fade, the same for a whole draw
+        #ifdef SHADER_INSTANCED
+            layout(location = 2) in vec3 a_instance_offset;
+            layout(location = 3) in vec3 a_instance_color;
+        #endif
+
+            // per-object entries, one buffer update per frame for every object drawn
+            struct Object
             {
-                gl_Position = u_transform *  vec4(a_position, 1);
-                vertex_normal = vec3(u_transform * vec4(a_normal,0));
-                vertex_position = vec3(gl_Position);
-            }
-        )VERTEX",
-
-        R"FRAGMENT(
-            #version 330 core
-            
-            in vec3 vertex_position;
-            in vec3 vertex_normal;
-            
-            out vec4 out_color;
-
-            void main()
+                mat4 transform;
+                vec4 color;
+                vec4 material; // x: shininess
+            };
+            layout(std140) uniform Objects
             {
-                vec3 color= vec3(0);
-                                               
-                vec3 surface_position = vertex_position;
-                vec3 surface_normal = normalize(vertex_normal);
-           
-                out_color = vec4(surface_normal, 1); // normal vectors as color values
-            }
-        )FRAGMENT");
-    
-    GLuint program3 = CreateProgramFromSources(
-        R"VERTEX(
-            #version 330 core
-
-            layout(location = 0) in vec3 a_position;
-            layout(location = 1) in vec3 a_normal;
-                                               
-            uniform mat4 u_transform;
-
+                Object object_data[64];
+            };
 
             out vec3 vertex_position;
             out vec3 vertex_normal;
-            void main()
+            out vec3 vertex_color;
+            flat out int vertex_object;
+            flat out float vertex_lod_fade;
+        #ifdef SHADER_PULLED
+            // grid corners (v, r) of the six vertices of a quad, in the order FillGridIndices writes its two triangles
+            const ivec2 triangle_corners[6] = ivec2[6](ivec2(1, 0), ivec2(0, 1), ivec2(0, 0), ivec2(1, 0), ivec2(1, 1), ivec2(0, 1));
+            // and of its three edges: along the profile, around the axis, across the diagonal
+            const ivec2 edge_corners[6] = ivec2[6](ivec2(0, 0), ivec2(1, 0), ivec2(0, 0), ivec2(0, 1), ivec2(1, 0), ivec2(0, 1));
+
+            void PullVertex(out vec3 position, out vec3 normal)
             {
-                gl_Position = u_transform *  vec4(a_position, 1);
-                vertex_normal = vec3(u_transform * vec4(a_normal,0));
-                vertex_position = vec3(gl_Position);
+                int segments = profile_shape.y - 1;
+                int rotations = profile_shape.z;
+                int quad = gl_VertexID / 6;
+                int corner = gl_VertexID - quad * 6;
+
+                ivec2 grid;
+                if (quad < segments * rotations)
+                    grid = ivec2(quad % segments, quad / segments) + (profile_shape.w != 0 ? edge_corners[corner] : triangle_corners[corner]);
+                else {
+                    // after the quads' edges, the ring around the last profile sample, two vertices per edge
+                    int ring = gl_VertexID - segments * rotations * 6;
+                    grid = ivec2(segments, ring / 2 + ring % 2);
+                }
+
+                // the last row wraps to the first exactly, as the indexed grid does
+                vec4 profile = texelFetch(profile_table, profile_shape.x + grid.x);
+                float angle = float(grid.y % rotations) / float(rotations) * 6.28318530718;
+                float c = cos(angle);
+                float s = sin(angle);
+                position = vec3(profile.x * c, profile.y, -profile.x * s); // glm::rotateY
+                normal = vec3(profile.z * c, profile.w, -profile.z * s);
             }
-        )VERTEX",
-
-        R"FRAGMENT(
-            #version 330 core
-                                                                  
-            in vec3 vertex_position;
-            in vec3 vertex_normal;
-            
-            out vec4 out_color;
+        #endif
 
             void main()
             {
-                vec3 color= vec3(0);
-                                               
-                vec3 surface_color = vec3(0.5, 0.5, 0.5); // gray surface color
-                vec3 surface_position = vertex_position;
-                vec3 surface_normal = normalize(vertex_normal);
-                            
-                // ambient light
-                float ambient_k = 1;
-                vec3 ambient_color= vec3(0.5, 0.5 , 0.5 );
-                color += ambient_k * ambient_color * surface_color;
-                
-                // directional light
-                vec3 light_direction = normalize(vec3(1, 1, -1)); // direction of light from the left upper corner to origin
-                vec3 light_color= vec3(0.4, 0.4, 0.4); // color of the directional light
-                
-                float diffuse_k= 1;
-                float diffuse_intensity = max(0, dot(light_direction, surface_normal));
-                color += diffuse_k * diffuse_intensity * light_color * surface_color;
-                 
-                vec3 view_dir = vec3(0,0,-1);
-                vec3 reflect_dir = reflect(-light_direction, surface_normal);
-                vec3 halfway_dir = normalize(view_dir + light_direction);
-                float specular_k = 1;
-                int shininess= 64;
-                float specular_intensity= pow(max(0, dot(halfway_dir, surface_normal)), shininess);
-                color += specular_k * specular_intensity * light_color;
-                                               
-                out_color = vec4(color, 1);
-            }
-        )FRAGMENT");
-    
-    GLuint program4 = CreateProgramFromSources(
-        R"VERTEX(
-            #version 330 core
-
-            layout(location = 0) in vec3 a_position;
-            layout(location = 1) in vec3 a_normal;
-
-            uniform mat4 u_transform;
-            
-            out vec3 vertex_position;
-            out vec3 vertex_normal;
-            void main()
-            {
-                gl_Position = u_transform *  vec4(a_position, 1);
-                vertex_normal = vec3(u_transform * vec4(a_normal,0));
+            #ifdef SHADER_PULLED
+                vec3 a_position, a_normal;
+                PullVertex(a_position, a_normal);
+            #endif
+                vertex_object = int(a_draw.x);
+                vertex_lod_fade = a_draw.y;
+                mat4 transform = object_data[vertex_object].transform;
+                gl_Position = transform *  vec4(a_position, 1);
+            #ifdef SHADER_INSTANCED
+                gl_Position += vec4(a_instance_offset, 0);
+                vertex_color = a_instance_color;
+            #else
+                vertex_color = object_data[vertex_object].color.rgb;
+            #endif
+                vertex_normal = vec3(transform * vec4(a_normal,0));
                 vertex_position = vec3(gl_Position);
             }
         )VERTEX",
 
         R"FRAGMENT(
-            #version 330 core
-                                               
-            uniform vec2 u_mouse_position;
-            uniform vec3 u_color;
-            uniform int u_shininess;
-                                               
-            in vec3 vertex_position;
-            in vec3 vertex_normal;
-            
-            out vec4 out_color;
-
-            void main()
+            // lights and inputs shared by every program
+            layout(std140) uniform Frame
             {
-                vec3 color= vec3(0);
-                                               
-                vec3 surface_color = u_color;
-                vec3 surface_position = vertex_position;
-                vec3 surface_normal = normalize(vertex_normal);
-                                               
-                float ambient_k = 1;
-                vec3 ambient_color= vec3(0.5, 0.5 , 0.5);
-                color += ambient_k * ambient_color * surface_color;
-                
-                vec3 light_direction = normalize(vec3(1,1, -1));
-                vec3 light_color= vec3(0.4, 0.4, 0.4);
-                                               
-                float diffuse_k= 1;
-                float diffuse_intensity = max(0, dot(light_direction, surface_normal));
-                color += diffuse_k * diffuse_intensity * light_color * surface_color;
-                 
-                vec3 view_dir = vec3(0,0,-1);
-                vec3 halfway_dir = normalize(view_dir + light_direction);
-                float specular_k = 1;
-                int shininess= u_shininess;
-                float specular_intensity= pow(max(0, dot(halfway_dir, surface_normal)), shininess);
-                color += specular_k * specular_intensity * light_color;
-                   
-                                               
-                // point light
-                vec3 point_light_position = (vec3(u_mouse_position, -1));
-                vec3 point_light_color= vec3(0.5, 0.5, 0.5);
-                vec3 to_point_light = normalize(point_light_position - surface_position);
-                
-                diffuse_k= 1;
-                diffuse_intensity = max(0, dot(to_point_light, surface_normal));
-                color += diffuse_k * diffuse_intensity * point_light_color * surface_color;
-                                                
-                halfway_dir = normalize(view_dir + to_point_light);
-                specular_k = 1;
-                specular_intensity= pow(max(0, dot(halfway_dir, surface_normal)), shininess);
-                color += specular_k * specular_intensity * point_light_color;
-                                               
-                                               
-                out_color = vec4(color, 1);
-            }
-        )FRAGMENT");
-    
-    GLuint program5 = CreateProgramFromSources(
-        R"VERTEX(
-            #version 330 core
-
-            layout(location = 0) in vec3 a_position;
-            layout(location = 1) in vec3 a_normal;
-
-            uniform mat4 u_transform;
-
-            out vec3 vertex_position;
-            out vec3 vertex_normal;
-            void main()
+                vec4 ambient_color;
+                vec4 light_direction; // towards the directional light
+                vec4 light_color;
+                vec4 point_light_color;
+                vec2 mouse_position;
+                float time;
+            } frame;
+
+            // per-object entries, one buffer update per frame for every object drawn
+            struct Object
             {
-                gl_Position = u_transform *  vec4(a_position, 1);
-                vertex_normal = vec3(u_transform * vec4(a_normal,0));
-                vertex_position = vec3(gl_Position);
-            }
-        )VERTEX",
+                mat4 transform;
+                vec4 color;
+                vec4 material; // x: shininess
+            };
+            layout(std140) uniform Objects
+            {
+                Object object_data[64];
+            };
 
-        R"FRAGMENT(
-            #version 330 core
-                                               
-            uniform vec2 u_mouse_position;
-           
             in vec3 vertex_position;
             in vec3 vertex_normal;
-            uniform vec3 u_color;
-            
+            in vec3 vertex_color;
+            flat in int vertex_object;
+            flat in float vertex_lod_fade; // 0 outside level-of-detail transitions
+
             out vec4 out_color;
 
             void main()
             {
+                // dithered cross-fade, the incoming and outgoing levels keep complementary pixels
+                float lod_dither = fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+                if (vertex_lod_fade != 0 && (lod_dither < abs(vertex_lod_fade)) != (vertex_lod_fade > 0))
+                    discard;
+
+            #if defined(SHADER_LIT)
                 vec3 color= vec3(0);
-                                               
-                vec3 surface_color = u_color;
+
+            #if defined(SHADER_OBJECT_MATERIAL) || defined(SHADER_INSTANCED)
+                vec3 surface_color = vertex_color;
+            #else
+                vec3 surface_color = vec3(0.5, 0.5, 0.5); // gray surface color
+            #endif
+            #ifdef SHADER_OBJECT_MATERIAL
+                float shininess = object_data[vertex_object].material.x;
+            #else
+                float shininess = 64;
+            #endif
                 vec3 surface_position = vertex_position;
                 vec3 surface_normal = normalize(vertex_normal);
-                                               
+
+                // ambient light
                 float ambient_k = 1;
-                vec3 ambient_color= vec3(0.5, 0.5 , 0.5);
+                vec3 ambient_color = frame.ambient_color.rgb;
                 color += ambient_k * ambient_color * surface_color;
-                
-                vec3 light_direction = normalize(vec3(1,1, -1));
-                vec3 light_color= vec3(0.4, 0.4, 0.4);
-                                               
+
+                // directional light
+                vec3 light_direction = frame.light_direction.xyz;
+                vec3 light_color = frame.light_color.rgb;
+
                 float diffuse_k= 1;
                 float diffuse_intensity = max(0, dot(light_direction, surface_normal));
                 color += diffuse_k * diffuse_intensity * light_color * surface_color;
-                 
+
                 vec3 view_dir = vec3(0,0,-1);
                 vec3 halfway_dir = normalize(view_dir + light_direction);
                 float specular_k = 1;
-                int shininess= 128;
                 float specular_intensity= pow(max(0, dot(halfway_dir, surface_normal)), shininess);
                 color += specular_k * specular_intensity * light_color;
-                   
-                                               
+
+            #ifdef SHADER_POINT_LIGHT
                 // point light
-                vec3 point_light_position = (vec3(u_mouse_position, -1));
-                vec3 point_light_color= vec3(0.5, 0.5, 0.5);
+                vec3 point_light_position = vec3(frame.mouse_position, -1);
+                vec3 point_light_color = frame.point_light_color.rgb;
                 vec3 to_point_light = normalize(point_light_position - surface_position);
-                
-                diffuse_k= 1;
+
                 diffuse_intensity = max(0, dot(to_point_light, surface_normal));
                 color += diffuse_k * diffuse_intensity * point_light_color * surface_color;
-                                                
+
                 halfway_dir = normalize(view_dir + to_point_light);
-                specular_k = 1;
                 specular_intensity= pow(max(0, dot(halfway_dir, surface_normal)), shininess);
                 color += specular_k * specular_intensity * point_light_color;
-                                               
-                                               
+            #endif
+
                 out_color = vec4(color, 1);
+            #elif defined(SHADER_NORMAL_COLOR)
+                out_color = vec4(normalize(vertex_normal), 1); // normal vectors as color values
+            #else
+                out_color = vec4(1,1,1,1); // color of wireframe
+            #endif
             }
-        )FRAGMENT");
-    
-    GLuint program6 = CreateProgramFromSources(
-        R"VERTEX(
-            #version 330 core
+        )FRAGMENT",
+        { "SHADER_LIT", "SHADER_NORMAL_COLOR", "SHADER_POINT_LIGHT", "SHADER_OBJECT_MATERIAL", "SHADER_INSTANCED", "SHADER_PULLED" });
 
-            layout(location = 0) in vec3 a_position;
-            layout(location = 1) in vec3 a_normal;
-                                               
-            uniform mat4 u_transform;
-
-
-            out vec3 vertex_position;
-            out vec3 vertex_normal;
-            void main()
-            {
-                gl_Position = u_transform *  vec4(a_position, 1);
-                vertex_normal = vec3(u_transform * vec4(a_normal,0));
-                vertex_position = vec3(gl_Position);
-            }
-        )VERTEX",
+	/* Creating Meshes */
+    
+    // meshes are spread over all cores, one per worker, each row is evaluated with the widest SIMD path available
+    ThreadPool generation_pool;
+    
+    // identical keys share one VAO, and meshes cached by an earlier launch are mapped instead of generated
+    // vertices are stored interleaved with packed normals, triangles reordered for the post-transform cache
+    // all of them are suballocated from one arena, so the queue draws a scene's objects with one bind
+    bool indirect_draws = EnableMultiDrawIndirect(load);
+    GeometryArena arena(VERTEX_LAYOUT_COMPACT);
+    MeshRegistry meshes("mesh_cache", VERTEX_LAYOUT_COMPACT, true, &arena);
+    
+    // nothing waits for the meshes: workers build them while the scenes already run, and each frame uploads a
+    // fixed amount of them; until a level arrives the chains draw the nearest one that has, or nothing
+    // declared after the pool and the registry its loader uses, so it stops first, and inside RunScenes so its
+    // fences and staging buffer are deleted before the context is gone
+    MeshStreamer streamer(meshes, generation_pool, GLsizeiptr(benchmark_settings.upload_budget_kb) << 10);
+    // every mesh is a chain of levels from the same profile, finest first; the finest keeps the original segment counts
+    std::vector<int> shape_levels = { 16, 10, 6 };
+    std::vector<int> spikes_levels = { 100, 50, 24 };
+    
+    // Sphere Mesh
+    MeshKey sphere_key = { "revolved", "half-circle", 16, 16 };
+    LodChain sphere_lod = BuildStreamedLodChain(streamer, sphere_key, shape_levels, [&](std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices, int vertical_segment, int rotation_segment) {
+        GenerateRevolvedShapeSIMD(positions, normals, indices, PROFILE_HALF_CIRCLE, vertical_segment, rotation_segment);
+    });
+    
+    // Torus Mesh
+    MeshKey torus_key = { "revolved", "circle", 16, 16 };
+    LodChain torus_lod = BuildStreamedLodChain(streamer, torus_key, shape_levels, [&](std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices, int vertical_segment, int rotation_segment) {
+        GenerateRevolvedShapeSIMD(positions, normals, indices, PROFILE_CIRCLE, vertical_segment, rotation_segment);
+    });
+    
+    // Spikes Torus Mesh
+    MeshKey spikestorus_key = { "revolved", "spikes", 100, 100 };
+    LodChain spikestorus_lod = BuildStreamedLodChain(streamer, spikestorus_key, spikes_levels, [&](std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices, int vertical_segment, int rotation_segment) {
+        GenerateRevolvedShapeSIMD(positions, normals, indices, PROFILE_SPIKES, vertical_segment, rotation_segment);
+    });
+    
+    // Spikes Mesh
+    MeshKey spikes_key = { "modulated", "spikes", 100, 100 };
+    LodChain spikes_lod = BuildStreamedLodChain(streamer, spikes_key, spikes_levels, [&](std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices, int vertical_segment, int rotation_segment) {
+        GenerateModulatedRevolvedShapeSIMD(positions, normals, indices, PROFILE_SPIKES, 6, vertical_segment, rotation_segment);
+    });
+
+    // each chain picks its levels by the chord error of its own profile, the spikes bend far more sharply than the sphere;
+    // the modulated surface scales its profile by up to 0.75
+    Curve2D sphere_profile = ShapeProfileCurve(PROFILE_HALF_CIRCLE);
+    Curve2D torus_profile = ShapeProfileCurve(PROFILE_CIRCLE);
+    Curve2D spikes_profile = ShapeProfileCurve(PROFILE_SPIKES);
+    sphere_lod.error_constant = ChordErrorConstant(shape_levels, sphere_profile, RevolutionRing(sphere_profile));
+    torus_lod.error_constant = ChordErrorConstant(shape_levels, torus_profile, RevolutionRing(torus_profile));
+    spikestorus_lod.error_constant = ChordErrorConstant(spikes_levels, spikes_profile, RevolutionRing(spikes_profile));
+    spikes_lod.error_constant = ChordErrorConstant(spikes_levels, ShapeProfileCurve(PROFILE_SPIKES, 0.75), RevolutionRing(spikes_profile, 6));
+
+    // both spikes meshes are rebuilt in the background whenever Globals.shape changes, the cached chains above
+    // are drawn until the first rebuilt ones are swapped in; the pulled spikes torus keeps its profile
+    // rebuilt levels are allocated in the arena as well, so a retuned scene still draws with one bind
+    LiveMesh spikestorus_live([](const ShapeParameters& shape, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices, int vertical_segment, int rotation_segment) {
+        GenerateRevolvedShapeSIMD(positions, normals, indices, ProfileShape(PROFILE_SPIKES, shape.spikes), vertical_segment, rotation_segment);
+    }, [](const ShapeParameters& shape, Curve2D& profile, Curve2D& ring) {
+        profile = ShapeProfileCurve(ProfileShape(PROFILE_SPIKES, shape.spikes));
+        ring = RevolutionRing(profile);
+    }, spikes_levels, VERTEX_LAYOUT_COMPACT, &arena);
+    LiveMesh spikes_live([](const ShapeParameters& shape, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices, int vertical_segment, int rotation_segment) {
+        GenerateModulatedRevolvedShapeSIMD(positions, normals, indices, ProfileShape(PROFILE_SPIKES, shape.spikes), shape.frequency, vertical_segment, rotation_segment);
+    }, [](const ShapeParameters& shape, Curve2D& profile, Curve2D& ring) {
+        Curve2D widest = ShapeProfileCurve(ProfileShape(PROFILE_SPIKES, shape.spikes));
+        profile = ShapeProfileCurve(ProfileShape(PROFILE_SPIKES, shape.spikes), 0.75);
+        ring = RevolutionRing(widest, shape.frequency);
+    }, spikes_levels, VERTEX_LAYOUT_COMPACT, &arena);
+    ShapeParameters drawn_shape = Globals.shape;
+
+    std::cout << "Streaming " << streamer.requested_count << " meshes on " << generation_pool.ThreadCount() << " threads ("
+              << SimdPathName(GetSimdPath()) << "), " << benchmark_settings.upload_budget_kb << " KB per frame" << std::endl;
+
+    /* Pulled Meshes */
+    // with --pulling the plain surfaces of revolution are drawn from their profiles alone, rebuilt in the vertex shader;
+    // the torus cloud keeps its vertex buffers for the instance attributes
+    ProfileTable profiles;
+    LodChain sphere_pulled_lod, torus_pulled_lod, spikestorus_pulled_lod;
+    bool pulling = benchmark_settings.vertex_pulling;
+    // with --strips solid meshes are drawn from their strips, the same triangles in fewer indices
+    GLenum solid_mode = benchmark_settings.triangle_strips ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+    if (pulling) {
+        sphere_pulled_lod = BuildPulledLodChain(profiles, shape_levels, [](std::vector<glm::vec2>& positions, std::vector<glm::vec2>& normals, int vertical_segment) {
+            SampleProfile(positions, normals, ParametricHalfCircleDual, vertical_segment);
+        });
+        torus_pulled_lod = BuildPulledLodChain(profiles, shape_levels, [](std::vector<glm::vec2>& positions, std::vector<glm::vec2>& normals, int vertical_segment) {
+            SampleProfile(positions, normals, ParametricCircleDual, vertical_segment);
+        });
+        spikestorus_pulled_lod = BuildPulledLodChain(profiles, spikes_levels, [](std::vector<glm::vec2>& positions, std::vector<glm::vec2>& normals, int vertical_segment) {
+            SampleProfile(positions, normals, ParametricSpikesDual, vertical_segment);
+        });
+        sphere_pulled_lod.error_constant = sphere_lod.error_constant;
+        torus_pulled_lod.error_constant = torus_lod.error_constant;
+        spikestorus_pulled_lod.error_constant = spikestorus_lod.error_constant;
+        profiles.Upload();
+        std::cout << "Profile table: " << profiles.texels.size() << " samples, " << profiles.texels.size() * sizeof(glm::vec4) << " bytes for "
+                  << profiles.meshes.size() << " meshes" << std::endl;
+    }
+    const LodChain& sphere_draw_lod = pulling ? sphere_pulled_lod : sphere_lod;
+    const LodChain& torus_draw_lod = pulling ? torus_pulled_lod : torus_lod;
+    const LodChain& spikestorus_draw_lod = pulling ? spikestorus_pulled_lod : spikestorus_lod;
+
+    /* Creating Instances */
+
+    // Scene 6 places one torus on every vertex of the spikes mesh, drawn with a single instanced call
+    std::vector<glm::vec3> instance_offsets;
+    std::vector<glm::vec3> instance_colors;
+    glm::mat4 cloud_transform(1.0);
+    cloud_transform = glm::scale(cloud_transform, glm::vec3(1.2));
+    cloud_transform = glm::rotate(cloud_transform, 90.0f, glm::vec3(1,0,0));
+
+    // culled every frame, only the visible instances are uploaded to the torus levels being drawn
+    InstanceCuller instance_culler;
+    auto place_instances = [&](const glm::vec3* positions, GLsizei vertex_count) {
+        instance_offsets.clear();
+        instance_colors.clear();
+        for (GLsizei i = 0; i < vertex_count; ++i) {
+            auto p = glm::vec3(cloud_transform * glm::vec4(positions[i], 1));
+            instance_offsets.push_back(p);
+            instance_colors.push_back(p + glm::vec3(0.3, 0.3, 0.3));
+        }
+        instance_culler.SetInstances(instance_offsets, instance_colors);
+    };
+    // placed once the finest spikes level is resident
+    bool instances_placed = false;
+    std::vector<glm::vec3> visible_offsets;
+    std::vector<glm::vec3> visible_colors;
+    InstanceBuffers cloud_instances;
+
+    /* Culling Statistics */
+    CullingStatistics culling, reported_culling;
+    double report_time = 0;
+    
+    /* Profiling */
+    // GPU time of the clear and of the scene, shown with the CPU zones once a second while profiling
+    GpuProfiler gpu_profiler;
+    double profile_report_time = 0;
 
-        R"FRAGMENT(
-            #version 330 core
-                                                                  
-            in vec3 vertex_position;
-            in vec3 vertex_normal;
-            uniform vec3 u_color;
-            out vec4 out_color;
+    /* Level Of Detail State */
+    LodSettings lod_settings;
+    LodState sphere_lod_state, chasing_lod_state, mouse_lod_state, cloud_lod_state;
+    LodState torus_lod_state, spikestorus_lod_state, spikes_lod_state;
 
-            void main()
-            {
-                vec3 color= vec3(0);
-                                               
-                vec3 surface_color =  u_color;
-                vec3 surface_position = vertex_position;
-                vec3 surface_normal = normalize(vertex_normal);
-                            
-                // ambient light
-                float ambient_k = 1;
-                vec3 ambient_color= vec3(0.5, 0.5 , 0.5 );
-                color += ambient_k * ambient_color * surface_color;
-                
-                // directional light
-                vec3 light_direction = normalize(vec3(1, 1, -1)); // direction of light from the left upper corner to origin
-                vec3 light_color= vec3(0.4, 0.4, 0.4); // color of the directional light
-                
-                float diffuse_k= 1;
-                float diffuse_intensity = max(0, dot(light_direction, surface_normal));
-                color += diffuse_k * diffuse_intensity * light_color * surface_color;
-                 
-                vec3 view_dir = vec3(0,0,-1);
-                vec3 reflect_dir = reflect(-light_direction, surface_normal);
-                vec3 halfway_dir = normalize(view_dir + light_direction);
-                float specular_k = 1;
-                int shininess= 64;
-                float specular_intensity= pow(max(0, dot(halfway_dir, surface_normal)), shininess);
-                color += specular_k * specular_intensity * light_color;
-                                               
-                out_color = vec4(color, 1);
-            }
-        )FRAGMENT");
     
-   
+    // scene 0 keeps drawing with no program bound
+    Program no_program;
+    int reported_uploads = 0, reported_uploads_avoided = 0;
     
-	if (program1 == NULL && program2 == NULL && program3 == NULL && program4 == NULL && program5 == NULL && program6 == NULL)
-	{
-		glfwTerminate();
-		return -1;
-	}
+    /* Render Queue */
+    RenderQueue queue;
+    int reported_issued = 0, reported_elided = 0;
+    
+    /* Uniform Blocks */
+    // frame data and per-object data share one buffer, bound to the same points in every program
+    UniformBuffer scene_uniforms;
+    GLintptr frame_block = scene_uniforms.AddBlock(FRAME_BINDING, sizeof(FrameUniforms));
+    GLintptr objects_block = scene_uniforms.AddBlock(OBJECTS_BINDING, max_objects * sizeof(ObjectUniforms));
+    shaders.BindUniformBlock("Frame", FRAME_BINDING);
+    shaders.BindUniformBlock("Objects", OBJECTS_BINDING);
+    
+    // the lights never change, only the mouse and the time are rewritten each frame
+    FrameUniforms& lights = *scene_uniforms.Block<FrameUniforms>(frame_block);
+    lights.ambient_color = glm::vec4(0.5, 0.5, 0.5, 0);
+    lights.light_direction = glm::vec4(glm::normalize(glm::vec3(1, 1, -1)), 0); // from the left upper corner to origin
+    lights.light_color = glm::vec4(0.4, 0.4, 0.4, 0);
+    lights.point_light_color = glm::vec4(0.5, 0.5, 0.5, 0);
+    
+    glm::vec2 chasing_pos(0);
+    bool first_frame = true;
 
     
+    SceneBenchmark benchmark(benchmark_settings);
+    int frame_number = 0;
+    bool fully_loaded = false;
+    
 	/* Loop until the user closes the window */
-    while (!glfwWindowShouldClose(window))
+    while (headless ? benchmark.Running() : !glfwWindowShouldClose(window))
     {
-        /* Render here */
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        
-        /* Uniform Values */
-        auto u_mouse_position_location = glGetUniformLocation(Globals.program, "u_mouse_position");
-        auto u_color_location = glGetUniformLocation(Globals.program, "u_color");
-        auto u_transform_location = glGetUniformLocation(Globals.program, "u_transform");
-        auto u_shininess_location = glGetUniformLocation(Globals.program, "u_shininess");
+        PROFILE_ZONE("Frame");
+        gpu_profiler.BeginFrame();
         
-        /* Scenes */
-        Globals.program= 0;
-        if (Globals.scene == 1) {
-            Globals.program = program1;
-        }
-        else if (Globals.scene == 2) {
-            Globals.program = program2;
+        if (headless) {
+            Globals.scene = benchmark.Scene();
+            benchmark.BeginFrame();
         }
-        else if (Globals.scene == 3) {
-            Globals.program = program3;
+        
+        /* Streamed Meshes */
+        if (!fully_loaded) {
+            if (streamer.Upload() > 0) {
+                for (LodChain* chain : { &sphere_lod, &torus_lod, &spikestorus_lod, &spikes_lod })
+                    chain->UpdateBoundingRadius();
+                if (!instances_placed && spikes_lod.levels[0]->resident && !spikes_live.HasChain()) {
+                    MeshView spikes_mesh = meshes.View(spikes_key);
+                    place_instances(spikes_mesh.positions, spikes_mesh.vertex_count);
+                    instances_placed = true;
+                }
+            }
+            if (streamer.Finished()) {
+                std::chrono::duration<double, std::milli> loaded_time = std::chrono::steady_clock::now() - startup_start;
+                benchmark.fully_loaded_ms = loaded_time.count();
+                std::cout << "Fully loaded after " << loaded_time.count() << " ms, " << frame_number << " frames: "
+                          << meshes.generated_count << " meshes generated, " << meshes.loaded_count << " loaded from cache, "
+                          << streamer.streamed_bytes / 1024 << " KB streamed over " << streamer.upload_frames << " frames" << std::endl;
+                std::cout << "Geometry arena: " << arena.vertices.capacity << " vertices, " << arena.indices.capacity << " indices, "
+                          << (indirect_draws ? "indirect" : "base vertex") << " multi-draw" << std::endl;
+                fully_loaded = true;
+            }
         }
-        else if (Globals.scene == 4) {
-            Globals.program = program4;
+        
+        /* Live Meshes */
+        // --retune steps every parameter on a fixed schedule, so headless runs measure frames during rebuilds
+        int retune = benchmark_settings.retune_frames;
+        if (headless && retune > 0 && frame_number > 0 && frame_number % retune == 0) {
+            int step = frame_number / retune;
+            Globals.shape.spikes = 6 + step % 8;
+            Globals.shape.frequency = float(4 + step % 5);
+            Globals.shape.segments = 60 + 20 * (step % 4);
         }
-        else if (Globals.scene == 5) {
-            Globals.program = program5;
+        ++frame_number;
+        if (Globals.shape != drawn_shape) {
+            spikestorus_live.Request(Globals.shape);
+            spikes_live.Request(Globals.shape);
         }
-        else if (Globals.scene == 6) {
-            Globals.program = program6;
+        {
+            PROFILE_ZONE("Swap live meshes");
+            spikestorus_live.Update();
+            if (spikes_live.Update()) {
+                instances_placed = true;
+                drawn_shape = spikes_live.Parameters();
+                place_instances(spikes_live.Positions().data(), GLsizei(spikes_live.Positions().size()));
+                if (!headless)
+                    std::cout << "Spikes rebuilt in " << spikes_live.generation_ms << " ms: " << drawn_shape.spikes << " spikes, frequency "
+                              << drawn_shape.frequency << ", " << drawn_shape.segments << " segments" << std::endl;
+            }
         }
-        glUseProgram(Globals.program);
+        const LodChain& spikestorus_chain = pulling || !spikestorus_live.HasChain() ? spikestorus_draw_lod : spikestorus_live.Chain();
+        const LodChain& spikes_chain = spikes_live.HasChain() ? spikes_live.Chain() : spikes_lod;
+        
+        /* Render here */
+        gpu_profiler.BeginPass("Clear");
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        gpu_profiler.EndPass();
+        
+        /* Uniform Values */
+        double time = headless ? benchmark.Time() : glfwGetTime();
+        LodDraw draws[2];
+        int draw_count;
+        culling = CullingStatistics();
         
         /* Dynamic Change in Mouse Positions */
         auto mouse_positions = Globals.mouse_position / glm::dvec2(Globals.screen_dimensions);
         mouse_positions.y = 1. - mouse_positions.y;
         mouse_positions = mouse_positions * 2. - 1. ;
-        glUniform2fv(u_mouse_position_location, 1, glm::value_ptr(glm::vec2(mouse_positions)));
-    
+        
+        FrameUniforms& frame = *scene_uniforms.Block<FrameUniforms>(frame_block);
+        frame.mouse_position = glm::vec2(mouse_positions);
+        frame.time = float(time);
+        
+        /* Object Values */
+        // every object of every scene is written first, then uploaded with one buffer update before any draw
+        ObjectUniforms* objects = scene_uniforms.Block<ObjectUniforms>(objects_block);
+        
         // Sphere Transformation
         glm::mat4 transform(1.0);
         transform = glm::translate(transform, glm::vec3(-0.5, 0.5, 0));
         transform = glm::scale(transform,glm::vec3(0.4));
-        transform = glm::rotate(transform, glm::radians(float(glfwGetTime()) * 10), glm::vec3(1,1,0));
-        glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(transform));
-
+        transform = glm::rotate(transform, glm::radians(float(time) * 10), glm::vec3(1,1,0));
+        objects[OBJECT_SPHERE] = { transform, glm::vec4(0.5,0.5,0.5,1), glm::vec4(128,0,0,0) };
+        
+        // Chasing Sphere
+        chasing_pos = glm::mix(glm::vec2(mouse_positions), chasing_pos, 0.99f);
+        transform = glm::mat4(1.0);
+        transform = glm::translate(transform, glm::vec3(chasing_pos, 0));
+        transform = glm::scale(transform,glm::vec3(0.3));
+        objects[OBJECT_CHASING_SPHERE] = { transform, glm::vec4(0.5,0.5,0.5,1), glm::vec4(128,0,0,0) };
+        
+        // Mouse Sphere, green while the chasing sphere is far away
+        transform = glm::mat4(1.0);
+        transform = glm::translate(transform, glm::vec3(mouse_positions, 0));
+        transform = glm::scale(transform,glm::vec3(0.3));
+        glm::vec4 mouse_color = glm::distance(glm::vec2(mouse_positions) , chasing_pos) > 0.3*2 ? glm::vec4(0,1,0,1) : glm::vec4(1,0,0,1);
+        objects[OBJECT_MOUSE_SPHERE] = { transform, mouse_color, glm::vec4(128,0,0,0) };
+        
+        // Torus Cloud, instance offsets and colors are in the torus levels, only the spin is shared
+        transform = glm::mat4(1.0);
+        transform = glm::scale(transform,glm::vec3(0.05));
+        transform = glm::rotate(transform, glm::radians(float(time) * 30), glm::vec3(1,1,0));
+        objects[OBJECT_TORUS_CLOUD] = { transform, glm::vec4(1), glm::vec4(64,0,0,0) };
+        
+        // Torus Transformation
+        transform = glm::mat4(1.0);
+        transform = glm::translate(transform, glm::vec3(0.5, 0.5, 0));
+        transform = glm::scale(transform,glm::vec3(0.4));
+        transform = glm::rotate(transform, glm::radians(float(time) * 10), glm::vec3(1,1,0));
+        objects[OBJECT_TORUS] = { transform, glm::vec4(1,0,0,1), glm::vec4(32,0,0,0) };
+        
+        // Spikes Torus Transformation
+        transform = glm::mat4(1.0);
+        transform = glm::translate(transform, glm::vec3(-0.5, -0.5, 0));
+        transform = glm::scale(transform,glm::vec3(0.4));
+        transform = glm::rotate(transform, glm::radians(float(time) * 10), glm::vec3(1,1,0));
+        objects[OBJECT_SPIKES_TORUS] = { transform, glm::vec4(0,1,0,1), glm::vec4(256,0,0,0) };
+        
+        // Spikes Transformation
+        transform = glm::mat4(1.0);
+        transform = glm::translate(transform, glm::vec3(0.5, -0.5, 0));
+        transform = glm::scale(transform,glm::vec3(0.4));
+        transform = glm::rotate(transform, glm::radians(float(time) * 10), glm::vec3(1,1,0));
+        objects[OBJECT_SPIKES] = { transform, glm::vec4(0,0,1,1), glm::vec4(512,0,0,0) };
+        
+        {
+            PROFILE_ZONE("Upload uniforms");
+            scene_uniforms.Upload();
+        }
+        
+        /* Scenes */
+        // in a window a variant still being built is only polled, its objects are skipped until the driver reports it
+        // linked, so compiling overlaps with the frames; benchmark frames wait so every measured frame draws the scene
+        Globals.program = &no_program;
+        if (Globals.scene >= 1 && Globals.scene <= 6) {
+            Program& variant = shaders.Get(scene_shaders[Globals.scene]);
+            if (headless ? variant.Resolve() : variant.Poll())
+                Globals.program = &variant;
+        }
+        Program& program = *Globals.program;
+        
+        // pulled meshes draw with the scene's features plus SHADER_PULLED, the torus cloud of scene 6 is never pulled
+        Program* pulled_program = &no_program;
+        if (pulling && Globals.scene >= 1 && Globals.scene <= 5) {
+            Program& variant = shaders.Get(scene_shaders[Globals.scene] | SHADER_PULLED);
+            if (headless ? variant.Resolve() : variant.Poll())
+                pulled_program = &variant;
+        }
+        Program& shape_program = pulling ? *pulled_program : program;
+        
         // Sphere WireFrame
-        glBindVertexArray(sphereVAO.id);
-        if(Globals.program == program1)
-            glDrawElements(GL_LINE_STRIP, sphereVAO.element_array_count, GL_UNSIGNED_INT, 0);
+        transform = objects[OBJECT_SPHERE].transform;
+        draw_count = sphere_draw_lod.Select(sphere_lod_state, transform, Globals.screen_dimensions, time, lod_settings, draws);
+        if(Globals.scene == 1)
+            DrawLevels(queue, draws, draw_count, GL_LINES, shape_program, OBJECT_SPHERE, transform, culling);
       
-        else if(Globals.program == program2 | Globals.program == program3)
-            glDrawElements(GL_TRIANGLES, sphereVAO.element_array_count, GL_UNSIGNED_INT, 0);
-       
-        else if(Globals.program == program4){
-            // Sphere Color
-            glUniform3fv(u_color_location,1,glm::value_ptr(glm::vec3(0.5,0.5,0.5)));
-            // Sphere Shininess
-            glUniform1i(u_shininess_location,128);
-            glDrawElements(GL_TRIANGLES, sphereVAO.element_array_count, GL_UNSIGNED_INT, 0);
-        }
+        else if(Globals.scene == 2 | Globals.scene == 3 | Globals.scene == 4)
+            DrawLevels(queue, draws, draw_count, solid_mode, shape_program, OBJECT_SPHERE, transform, culling);
         
-        else if(Globals.program == program5){
+        else if(Globals.scene == 5){
 
             // Chasing Sphere
-            glUniform3fv(u_color_location,1,glm::value_ptr(glm::vec3(0.5,0.5,0.5)));
-            glm::vec2 chasing_pos = glm::mix(glm::vec2(mouse_positions), chasing_pos, 0.99);
-            transform = glm::mat4(1.0);
-            transform = glm::translate(transform, glm::vec3(chasing_pos, 0));
-            transform = glm::scale(transform,glm::vec3(0.3));
-            
-            glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(transform));
-            glDrawElements(GL_TRIANGLES, sphereVAO.element_array_count, GL_UNSIGNED_INT, 0);
-            
-            if (glm::distance(glm::vec2(mouse_positions) , chasing_pos) > 0.3*2)
-                glUniform3fv(u_color_location,1,glm::value_ptr(glm::vec3(0,1,0)));
-            
-            else
-            glUniform3fv(u_color_location,1,glm::value_ptr(glm::vec3(1,0,0)));
+            transform = objects[OBJECT_CHASING_SPHERE].transform;
+            draw_count = sphere_draw_lod.Select(chasing_lod_state, transform, Globals.screen_dimensions, time, lod_settings, draws);
+            DrawLevels(queue, draws, draw_count, solid_mode, shape_program, OBJECT_CHASING_SPHERE, transform, culling);
             
-            transform = glm::mat4(1.0);
-            transform = glm::translate(transform, glm::vec3(mouse_positions, 0));
-            transform = glm::scale(transform,glm::vec3(0.3));
-            
-            glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(transform));
-            glDrawElements(GL_TRIANGLES, sphereVAO.element_array_count, GL_UNSIGNED_INT, 0);
+            // Mouse Sphere
+            transform = objects[OBJECT_MOUSE_SPHERE].transform;
+            draw_count = sphere_draw_lod.Select(mouse_lod_state, transform, Globals.screen_dimensions, time, lod_settings, draws);
+            DrawLevels(queue, draws, draw_count, solid_mode, shape_program, OBJECT_MOUSE_SPHERE, transform, culling);
         }
         
         else{
             // Scene 6
-            transform = glm::mat4(1.0);
-            transform = glm::scale(transform,glm::vec3(1.2));
-            transform = glm::rotate(transform, 90.0f, glm::vec3(1,0,0));
-            
-            
-            std::vector<glm::vec3> p2;
-            for (int j=0; j<positions.size(); j++) {
-                auto p= transform * glm::vec4(positions[j],1);
-                
-                p2.push_back(glm::vec3(p));
-            }
-
-            for (GLuint i=0; i < p2.size(); i += 1) {
-                transform = glm::mat4(1.0);
-                transform = glm::translate(transform, glm::vec3(p2[i]));
-                transform = glm::scale(transform,glm::vec3(0.05));
-                transform = glm::rotate(transform, glm::radians(float(glfwGetTime()) * 30), glm::vec3(1,1,0));
-                glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(transform));
-                glUniform3fv(u_color_location,1,glm::value_ptr(p2[i]+glm::vec3(0.3,0.3,0.3)));
-                
-                // Torus WireFrame
-                glBindVertexArray(torusVAO.id);
-                glDrawElements(GL_TRIANGLES, torusVAO.element_array_count, GL_UNSIGNED_INT, 0);
-            }
+            transform = objects[OBJECT_TORUS_CLOUD].transform;
             
+            // Torus Cloud
+            // offsets only translate, so the shared transform alone sets the on-screen size of every instance
+            draw_count = torus_lod.Select(cloud_lod_state, transform, Globals.screen_dimensions, time, lod_settings, draws);
+            // the visible instances are uploaded once, only when they changed, and every drawn level reads them
+            if (draw_count > 0 && instance_culler.Cull(draws[0].vao->bounds, transform, visible_offsets, visible_colors, culling))
+                cloud_instances.Upload(visible_offsets, visible_colors);
+            for (int i = 0; i < draw_count; ++i)
+                draws[i].vao->SetInstances(cloud_instances);
+            DrawInstancedLevels(queue, draws, draw_count, solid_mode, program, OBJECT_TORUS_CLOUD);
         }
         
         
         
-        // Torus Transformation
-        transform = glm::mat4(1.0);
-        transform = glm::translate(transform, glm::vec3(0.5, 0.5, 0));
-        transform = glm::scale(transform,glm::vec3(0.4));
-        transform = glm::rotate(transform, glm::radians(float(glfwGetTime()) * 10), glm::vec3(1,1,0));
-        glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(transform));
-
         // Torus WireFrame
-        glBindVertexArray(torusVAO.id);
-        if(Globals.program == program1){
-            glDrawElements(GL_LINE_STRIP, torusVAO.element_array_count, GL_UNSIGNED_INT, 0);}
-        
-        else if(Globals.program == program2 | Globals.program == program3)
-            glDrawElements(GL_TRIANGLES, torusVAO.element_array_count, GL_UNSIGNED_INT, 0);
-        
-        else if(Globals.program == program4){
-            // Torus Color
-            glUniform3fv(u_color_location,1,glm::value_ptr(glm::vec3(1,0,0)));
-            // Torus Shininess
-            glUniform1i(u_shininess_location,32);
-            glDrawElements(GL_TRIANGLES, torusVAO.element_array_count, GL_UNSIGNED_INT, 0);
-        }
+        transform = objects[OBJECT_TORUS].transform;
+        draw_count = torus_draw_lod.Select(torus_lod_state, transform, Globals.screen_dimensions, time, lod_settings, draws);
+        if(Globals.scene == 1){
+            DrawLevels(queue, draws, draw_count, GL_LINES, shape_program, OBJECT_TORUS, transform, culling);}
+        
+        else if(Globals.scene == 2 | Globals.scene == 3 | Globals.scene == 4)
+            DrawLevels(queue, draws, draw_count, solid_mode, shape_program, OBJECT_TORUS, transform, culling);
        
         
         
-        // Spikes Torus Transformation
-        transform = glm::mat4(1.0);
-        transform = glm::translate(transform, glm::vec3(-0.5, -0.5, 0));
-        transform = glm::scale(transform,glm::vec3(0.4));
-        transform = glm::rotate(transform, glm::radians(float(glfwGetTime()) * 10), glm::vec3(1,1,0));
-        glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(transform));
-
         // Spikes Torus WireFrame
-        glBindVertexArray(spikestorusVAO.id);
-        if(Globals.program == program1){
-            glDrawElements(GL_LINE_STRIP, spikestorusVAO.element_array_count, GL_UNSIGNED_INT, 0);}
-        
-        else if(Globals.program == program2 | Globals.program == program3)
-            glDrawElements(GL_TRIANGLES, spikestorusVAO.element_array_count, GL_UNSIGNED_INT, 0);
-        
-        else if(Globals.program == program4){
-            // Spikes Torus Color
-            glUniform3fv(u_color_location,1,glm::value_ptr(glm::vec3(0,1,0)));
-            // Spikes Torus Shininess
-            glUniform1i(u_shininess_location,256);
-            glDrawElements(GL_TRIANGLES, spikestorusVAO.element_array_count, GL_UNSIGNED_INT, 0);
-        }
+        transform = objects[OBJECT_SPIKES_TORUS].transform;
+        draw_count = spikestorus_chain.Select(spikestorus_lod_state, transform, Globals.screen_dimensions, time, lod_settings, draws);
+        if(Globals.scene == 1){
+            DrawLevels(queue, draws, draw_count, GL_LINES, shape_program, OBJECT_SPIKES_TORUS, transform, culling);}
+        
+        else if(Globals.scene == 2 | Globals.scene == 3 | Globals.scene == 4)
+            DrawLevels(queue, draws, draw_count, solid_mode, shape_program, OBJECT_SPIKES_TORUS, transform, culling);
         
         
         
-        // Spikes Transformation
-        transform = glm::mat4(1.0);
-        transform = glm::translate(transform, glm::vec3(0.5, -0.5, 0));
-        transform = glm::scale(transform,glm::vec3(0.4));
-        transform = glm::rotate(transform, glm::radians(float(glfwGetTime()) * 10), glm::vec3(1,1,0));
-        glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(transform));
-
         // Spikes WireFrame
-        glBindVertexArray(spikesVAO.id);
-        if(Globals.program == program1){
-            glDrawElements(GL_LINE_STRIP, spikesVAO.element_array_count, GL_UNSIGNED_INT, 0);}
+        transform = objects[OBJECT_SPIKES].transform;
+        draw_count = spikes_chain.Select(spikes_lod_state, transform, Globals.screen_dimensions, time, lod_settings, draws);
+        if(Globals.scene == 1){
+            DrawLevels(queue, draws, draw_count, GL_LINES, program, OBJECT_SPIKES, transform, culling);}
      
-        else if(Globals.program == program2 | Globals.program == program3)
-            glDrawElements(GL_TRIANGLES, spikesVAO.element_array_count, GL_UNSIGNED_INT, 0);
-        
-        else if(Globals.program == program4){
-            // Spikes Color
-            glUniform3fv(u_color_location,1,glm::value_ptr(glm::vec3(0,0,1)));
-            // Spikes Shininess
-            glUniform1i(u_shininess_location,512);
-            glDrawElements(GL_TRIANGLES, spikesVAO.element_array_count, GL_UNSIGNED_INT, 0);
+        else if(Globals.scene == 2 | Globals.scene == 3 | Globals.scene == 4)
+            DrawLevels(queue, draws, draw_count, solid_mode, program, OBJECT_SPIKES, transform, culling);
+        
+        // sorted by program and vertex array, the same bindings are issued once however the scene submits them
+        {
+            PROFILE_ZONE("Flush render queue");
+            gpu_profiler.BeginPass("Scene");
+            queue.Flush();
+            gpu_profiler.EndPass();
         }
         
+        /* Frame Report */
+        int uploads = 0, uploads_avoided = 0;
+        for (auto& counted : shaders.variants) {
+            uploads += counted.second->uploads;
+            uploads_avoided += counted.second->uploads_avoided;
+            counted.second->ResetCounters();
+        }
+        
+        // printed at most once a second, and only when the counts changed
+        bool report_changed = culling.visible != reported_culling.visible || culling.culled != reported_culling.culled
+            || uploads != reported_uploads || uploads_avoided != reported_uploads_avoided
+            || queue.state.issued != reported_issued || queue.state.elided != reported_elided;
+        if (!headless && time - report_time >= 1 && report_changed) {
+            std::cout << "Frame: " << culling.visible << " visible, " << culling.culled << " culled, "
+                      << uploads << " uniform uploads, " << uploads_avoided << " avoided, "
+                      << queue.draw_calls << " draw calls, " << queue.state.issued << " state changes issued, " << queue.state.elided << " elided" << std::endl;
+            reported_culling = culling;
+            reported_uploads = uploads;
+            reported_uploads_avoided = uploads_avoided;
+            reported_issued = queue.state.issued;
+            reported_elided = queue.state.elided;
+            report_time = time;
+        }
+        if (headless)
+            benchmark.EndFrame(queue.draw_calls, queue.triangles);
+        queue.ResetCounters();
+        
         /* Swap front and back buffers */
-        glfwSwapBuffers(window);
+        if (!headless) {
+            PROFILE_ZONE("Swap buffers");
+            glfwSwapBuffers(window);
+        }
+        
+        if (!headless && IsProfilerEnabled() && time - profile_report_time >= 1) {
+            PrintProfileSummary(std::cout);
+            profile_report_time = time;
+        }
+        
+        if (first_frame) {
+            std::chrono::duration<double, std::milli> startup_time = std::chrono::steady_clock::now() - startup_start;
+            benchmark.first_frame_ms = startup_time.count();
+            std::cout << "First frame after " << startup_time.count() << " ms, " << shaders.variants.size() << " shader variants built ("
+                      << (parallel_compile ? "parallel" : "serial") << " compile)" << std::endl;
+            first_frame = false;
+        }
 
         /* Poll for and process events */
-        glfwPollEvents();
+        if (!headless)
+            glfwPollEvents();
     }
     
+	if (!benchmark_settings.trace_path.empty())
+		WriteChromeTrace(benchmark_settings.trace_path);
 
-    
-	glfwTerminate();
+	if (headless)
+		return benchmark.WriteReport(reinterpret_cast<const char*>(glGetString(GL_RENDERER))) ? 0 : 1;
 	return 0;
 }
@@ -0,0 +1,359 @@
+// Standalone timing of the mesh generators, and optionally of VAO uploads, written out as JSON.
+// Builds on its own with mesh_generation.cpp, thread_pool.cpp, profiler.cpp and glad.c, which holds the GPU timer
+// query entry points profiler.cpp refers to. They are never called, so no window, context or GL library is needed.
+// Defining MESH_BENCHMARK_UPLOAD adds the --upload case, which also needs opengl_utilities.cpp, program_cache.cpp,
+// mesh_cache.cpp, mesh_optimization.cpp, headless.cpp, glad and EGL.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/constants.hpp"
+#include "glm/gtx/rotate_vector.hpp"
+#include "glad/glad.h"
+
+#include "mesh_generation.h"
+#include "thread_pool.h"
+
+#ifdef MESH_BENCHMARK_UPLOAD
+#include "headless.h"
+#include "opengl_utilities.h"
+#endif
+
+/* Allocation Tracking */
+
+// Every allocation in the process goes through these, each block carries its size in front of it.
+namespace
+{
+	std::atomic<long long> allocation_count(0);
+	std::atomic<long long> live_bytes(0);
+	std::atomic<long long> peak_bytes(0);
+
+	const size_t allocation_header = alignof(std::max_align_t);
+}
+
+void* operator new(size_t size)
+{
+	unsigned char* block = static_cast<unsigned char*>(std::malloc(size + allocation_header));
+	if (!block)
+		throw std::bad_alloc();
+	*reinterpret_cast<size_t*>(block) = size;
+
+	++allocation_count;
+	long long live = live_bytes += (long long)size;
+	long long peak = peak_bytes.load();
+	while (live > peak && !peak_bytes.compare_exchange_weak(peak, live))
+		;
+	return block + allocation_header;
+}
+
+void operator delete(void* pointer) noexcept
+{
+	if (!pointer)
+		return;
+	unsigned char* block = static_cast<unsigned char*>(pointer) - allocation_header;
+	live_bytes -= (long long)*reinterpret_cast<size_t*>(block);
+	std::free(block);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	operator delete(pointer);
+}
+
+/* Benchmark Cases */
+
+struct BenchmarkOptions
+{
+	std::vector<int> segments = { 16, 64, 256, 1024, 4096 }; // vertical and rotation segments alike
+	std::vector<double> errors = { 1e-2, 1e-3, 1e-4 }; // error budgets of the adaptive generators
+	int threads = 0; // 0 generates on the calling thread only
+	double min_seconds = 0.25; // each case repeats until it has run this long, at least min_runs times
+	int min_runs = 3;
+	bool upload = false;
+	std::string output_path = "mesh_benchmark.json";
+};
+
+struct CaseResult
+{
+	std::string generator;
+	std::string curve;
+	int segments; // 0 for the adaptive generators, which pick their own
+	double max_error; // 0 for the uniform generators
+	int runs;
+	double best_ms;
+	double mean_ms;
+	long long vertices;
+	long long triangles;
+	long long allocations; // per run
+	long long peak_bytes;  // above what was live when the run started
+};
+
+typedef std::function<void(std::vector<glm::vec3>&, std::vector<glm::vec3>&, std::vector<GLuint>&)> GenerateCase;
+
+// Sweeps a 2D curve around Y, so GenerateParametricShapeFrom3D runs on the same three shapes.
+template<glm::dvec2(*Curve)(double)>
+static glm::dvec3 SweptCurve(double t, double r)
+{
+	return glm::rotateY(glm::dvec3(Curve(t), 0), r * glm::two_pi<double>());
+}
+
+static CaseResult RunCase(const std::string& generator, const std::string& curve, int segments, double max_error, const BenchmarkOptions& options, const GenerateCase& generate)
+{
+	CaseResult result = { generator, curve, segments, max_error, 0, 0, 0, 0, 0, 0, 0 };
+	double total_ms = 0;
+
+	while (result.runs < options.min_runs || total_ms < options.min_seconds * 1000)
+	{
+		long long allocations_before = allocation_count.load();
+		long long live_before = live_bytes.load();
+		peak_bytes = live_before;
+
+		auto start = std::chrono::steady_clock::now();
+		{
+			std::vector<glm::vec3> positions;
+			std::vector<glm::vec3> normals;
+			std::vector<GLuint> indices;
+			generate(positions, normals, indices);
+			result.vertices = (long long)positions.size();
+			result.triangles = (long long)indices.size() / 3;
+		}
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		result.allocations = allocation_count.load() - allocations_before;
+		result.peak_bytes = peak_bytes.load() - live_before;
+		result.best_ms = result.runs == 0 ? elapsed.count() : std::min(result.best_ms, elapsed.count());
+		total_ms += elapsed.count();
+		++result.runs;
+	}
+
+	result.mean_ms = total_ms / result.runs;
+	return result;
+}
+
+static void PrintResult(const CaseResult& result)
+{
+	std::cout << result.generator << " " << result.curve << " ";
+	if (result.segments > 0)
+		std::cout << result.segments << "x" << result.segments;
+	else
+		std::cout << "error " << result.max_error;
+	std::cout << ": " << result.best_ms << " ms, " << result.vertices << " vertices, " << result.triangles << " triangles, "
+		<< result.vertices / result.best_ms / 1e3 << " M vertices/s, " << result.allocations << " allocations, "
+		<< result.peak_bytes / (1024.0 * 1024.0) << " MiB peak" << std::endl;
+}
+
+#ifdef MESH_BENCHMARK_UPLOAD
+
+// Times VAO construction from generated arrays in every layout, including the driver's copy (glFinish).
+static std::vector<CaseResult> RunUploadCases(const BenchmarkOptions& options)
+{
+	std::vector<CaseResult> results;
+
+	HeadlessContext context;
+	if (!context.Create() || !gladLoadGLLoader(HeadlessContext::GetProcAddress))
+	{
+		std::cout << "Upload cases skipped, no offscreen context" << std::endl;
+		return results;
+	}
+
+	const char* layout_names[] = { "separate", "compact", "compact-half" };
+	for (int segments : options.segments)
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<GLuint> indices;
+		GenerateParametricShapeFrom2D(positions, normals, indices, ParametricCircle, segments, segments);
+
+		for (int layout = VERTEX_LAYOUT_SEPARATE; layout <= VERTEX_LAYOUT_COMPACT_HALF; ++layout)
+		{
+			CaseResult result = RunCase("VAO upload", layout_names[layout], segments, 0, options,
+				[&](std::vector<glm::vec3>&, std::vector<glm::vec3>&, std::vector<GLuint>&) {
+					VAO vao(positions, normals, indices, VertexLayout(layout));
+					glFinish();
+
+					// VAOs own their GL objects for the whole run of the application, here they go at once
+					glDeleteVertexArrays(1, &vao.id);
+					glDeleteBuffers(1, &vao.position_buffer);
+					if (vao.normals_buffer != vao.position_buffer)
+						glDeleteBuffers(1, &vao.normals_buffer);
+					glDeleteBuffers(1, &vao.element_array_buffer);
+				});
+			result.vertices = (long long)positions.size();
+			result.triangles = (long long)indices.size() / 3;
+			PrintResult(result);
+			results.push_back(result);
+		}
+	}
+	return results;
+}
+
+#endif
+
+/* Report */
+
+static bool WriteResults(const BenchmarkOptions& options, const std::vector<CaseResult>& results)
+{
+	std::ofstream file(options.output_path, std::ios::trunc);
+	file << "{\n";
+	file << "  \"threads\": " << options.threads << ",\n";
+	file << "  \"cases\": [\n";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const CaseResult& result = results[i];
+		file << "    { \"generator\": \"" << result.generator << "\", \"curve\": \"" << result.curve << "\""
+			<< ", \"segments\": " << result.segments
+			<< ", \"max_error\": " << result.max_error
+			<< ", \"runs\": " << result.runs
+			<< ", \"best_ms\": " << result.best_ms
+			<< ", \"mean_ms\": " << result.mean_ms
+			<< ", \"vertices\": " << result.vertices
+			<< ", \"triangles\": " << result.triangles
+			<< ", \"vertices_per_second\": " << result.vertices / result.best_ms * 1e3
+			<< ", \"allocations\": " << result.allocations
+			<< ", \"peak_bytes\": " << result.peak_bytes
+			<< " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	file << "  ]\n";
+	file << "}\n";
+
+	if (!file)
+	{
+		std::cout << "Error: Cannot write " << options.output_path << std::endl;
+		return false;
+	}
+	std::cout << "Results written to " << options.output_path << std::endl;
+	return true;
+}
+
+// Reads --segments 16,64,..., --errors 0.01,0.001,..., --threads N, --min-seconds S, --upload and --output PATH.
+static void ParseOptions(int argc, char* argv[], BenchmarkOptions& options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* option = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (std::strcmp(option, "--upload") == 0)
+			options.upload = true;
+		else if (std::strcmp(option, "--threads") == 0 && value && std::sscanf(value, "%d", &options.threads) == 1)
+			++i;
+		else if (std::strcmp(option, "--min-seconds") == 0 && value && std::sscanf(value, "%lf", &options.min_seconds) == 1)
+			++i;
+		else if (std::strcmp(option, "--output") == 0 && value)
+		{
+			options.output_path = value;
+			++i;
+		}
+		else if (std::strcmp(option, "--segments") == 0 && value)
+		{
+			options.segments.clear();
+			std::stringstream list(value);
+			std::string count;
+			while (std::getline(list, count, ','))
+				if (std::atoi(count.c_str()) > 0)
+					options.segments.push_back(std::atoi(count.c_str()));
+			++i;
+		}
+		else if (std::strcmp(option, "--errors") == 0 && value)
+		{
+			options.errors.clear();
+			std::stringstream list(value);
+			std::string error;
+			while (std::getline(list, error, ','))
+				if (std::atof(error.c_str()) > 0)
+					options.errors.push_back(std::atof(error.c_str()));
+			++i;
+		}
+		else
+			std::cout << "Error: Unknown or incomplete option " << option << std::endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	BenchmarkOptions options;
+	ParseOptions(argc, argv, options);
+
+	std::unique_ptr<ThreadPool> pool;
+	if (options.threads > 0)
+		pool.reset(new ThreadPool(options.threads));
+	ThreadPool* generation_pool = pool.get();
+
+	struct Curve
+	{
+		const char* name;
+		glm::dvec2(*line)(double);
+		glm::dvec3(*surface)(double, double);
+	};
+	const Curve curves[] = {
+		{ "half-circle", ParametricHalfCircle, SweptCurve<ParametricHalfCircle> },
+		{ "circle", ParametricCircle, SweptCurve<ParametricCircle> },
+		{ "spikes", ParametricSpikes, SweptCurve<ParametricSpikes> },
+	};
+
+	// the allocation counts include the pool's own per-call bookkeeping, as the renderer pays it too
+	std::vector<CaseResult> results;
+	for (const Curve& curve : curves)
+	{
+		for (int segments : options.segments)
+		{
+			results.push_back(RunCase("From2D", curve.name, segments, 0, options,
+				[&](std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices) {
+					GenerateParametricShapeFrom2D(positions, normals, indices, curve.line, segments, segments, generation_pool);
+				}));
+			PrintResult(results.back());
+			results.push_back(RunCase("From2D_2", curve.name, segments, 0, options,
+				[&](std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices) {
+					GenerateParametricShapeFrom2D_2(positions, normals, indices, curve.line, segments, segments, generation_pool);
+				}));
+			PrintResult(results.back());
+			results.push_back(RunCase("From3D", curve.name, segments, 0, options,
+				[&](std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices) {
+					GenerateParametricShapeFrom3D(positions, normals, indices, curve.surface, segments, segments, generation_pool);
+				}));
+			PrintResult(results.back());
+		}
+
+		// the same shapes sampled against an error budget, to set against the segment counts reaching that error
+		for (double max_error : options.errors)
+		{
+			AdaptiveTessellation tessellation;
+			tessellation.max_error = max_error;
+			results.push_back(RunCase("Adaptive", curve.name, 0, max_error, options,
+				[&](std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices) {
+					GenerateAdaptiveShapeFrom2D(positions, normals, indices, curve.line, tessellation, generation_pool);
+				}));
+			PrintResult(results.back());
+			results.push_back(RunCase("Adaptive_2", curve.name, 0, max_error, options,
+				[&](std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices) {
+					GenerateAdaptiveShapeFrom2D_2(positions, normals, indices, curve.line, tessellation, generation_pool);
+				}));
+			PrintResult(results.back());
+		}
+	}
+
+	if (options.upload)
+	{
+#ifdef MESH_BENCHMARK_UPLOAD
+		std::vector<CaseResult> upload_results = RunUploadCases(options);
+		results.insert(results.end(), upload_results.begin(), upload_results.end());
+#else
+		std::cout << "Upload cases skipped, built without MESH_BENCHMARK_UPLOAD" << std::endl;
+#endif
+	}
+
+	return WriteResults(options, results) ? 0 : 1;
+}
@@ -0,0 +1,377 @@
+#include "mesh_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "mesh_optimization.h"
+#include "profiler.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Cache File Format */
+
+// Bump whenever generator output changes so stale files are regenerated.
+static const uint32_t mesh_cache_magic = 0x48534D50; // "PMSH"
+static const uint32_t mesh_cache_version = 4; // 2: optimized meshes are welded, 3: packed GPU layout stored, 4: strips
+
+// Followed by the key name, then positions, normals and indices, then the packed vertices and elements,
+// each at the given offset. The packed parts are uploaded as they are.
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t key_length;
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t edge_count;
+	uint32_t strip_count;
+	uint32_t layout;
+	uint32_t index_type;
+	uint32_t positions_offset;
+	uint32_t normals_offset;
+	uint32_t indices_offset;
+	uint32_t packed_vertices_offset;
+	uint32_t packed_vertices_size;
+	uint32_t packed_elements_offset;
+	uint32_t packed_elements_size;
+	BoundingVolume bounds;
+};
+
+static uint32_t AlignTo4(size_t offset)
+{
+	return uint32_t((offset + 3) & ~size_t(3));
+}
+
+/* Mesh Keys */
+
+std::string MeshKey::Name() const
+{
+	return generator + "-" + curve + "-" + std::to_string(vertical_segments) + "x" + std::to_string(rotation_segments);
+}
+
+bool MeshKey::operator<(const MeshKey& other) const
+{
+	if (generator != other.generator)
+		return generator < other.generator;
+	if (curve != other.curve)
+		return curve < other.curve;
+	if (vertical_segments != other.vertical_segments)
+		return vertical_segments < other.vertical_segments;
+	return rotation_segments < other.rotation_segments;
+}
+
+/* Mapped File */
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path)
+	: data(nullptr), size(0), file_handle(INVALID_HANDLE_VALUE), mapping_handle(nullptr)
+{
+	file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE)
+		return;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+		return;
+
+	mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping_handle)
+		return;
+
+	data = static_cast<const unsigned char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+	if (data)
+		size = size_t(file_size.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping_handle)
+		CloseHandle(mapping_handle);
+	if (file_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(file_handle);
+}
+
+void MakeCacheDirectory(const std::string& path)
+{
+	_mkdir(path.c_str());
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+	: data(nullptr), size(0), file_descriptor(-1)
+{
+	file_descriptor = open(path.c_str(), O_RDONLY);
+	if (file_descriptor < 0)
+		return;
+
+	struct stat file_status;
+	if (fstat(file_descriptor, &file_status) != 0 || file_status.st_size == 0)
+		return;
+
+	void* mapping = mmap(nullptr, size_t(file_status.st_size), PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	if (mapping == MAP_FAILED)
+		return;
+
+	data = static_cast<const unsigned char*>(mapping);
+	size = size_t(file_status.st_size);
+}
+
+MappedFile::~MappedFile()
+{
+	if (data)
+		munmap(const_cast<unsigned char*>(data), size);
+	if (file_descriptor >= 0)
+		close(file_descriptor);
+}
+
+void MakeCacheDirectory(const std::string& path)
+{
+	mkdir(path.c_str(), 0755);
+}
+
+#endif
+
+/* Mesh Registry */
+
+MeshRegistry::MeshRegistry(const std::string& cache_directory, VertexLayout layout, bool optimize, GeometryArena* arena)
+	: generated_count(0), loaded_count(0), shared_count(0), cache_directory(cache_directory), layout(layout), optimize(optimize), arena(arena)
+{
+	if (!cache_directory.empty())
+		MakeCacheDirectory(cache_directory);
+}
+
+MeshRegistry::Entry* MeshRegistry::Find(const MeshKey& key) const
+{
+	std::lock_guard<std::mutex> lock(entries_mutex);
+	auto found = entries.find(key);
+	return found != entries.end() ? found->second.get() : nullptr;
+}
+
+void MeshRegistry::Fill(const MeshKey& key, Entry& entry, const Generator& generate)
+{
+	if (!LoadCacheFile(key, entry))
+	{
+		ProfileZone zone(IsProfilerEnabled() ? InternZoneName("Generate " + key.Name()) : nullptr);
+		generate(entry.positions, entry.normals, entry.indices);
+		if (optimize)
+			OptimizeMesh(entry.positions, entry.normals, entry.indices, key.Name().c_str());
+		entry.view.positions = entry.positions.data();
+		entry.view.normals = entry.normals.data();
+		entry.view.vertex_count = GLsizei(entry.positions.size());
+		entry.view.indices = entry.indices.data();
+		entry.view.index_count = GLsizei(entry.indices.size());
+		entry.view.packed = PackMesh(layout, entry.view.positions, entry.view.normals, entry.view.vertex_count,
+			entry.view.indices, entry.view.index_count, entry.packed_vertices, entry.packed_elements);
+		++generated_count;
+
+		WriteCacheFile(key, entry);
+	}
+	else
+		++loaded_count;
+}
+
+VAO& MeshRegistry::Get(const MeshKey& key, const Generator& generate)
+{
+	if (Entry* found = Find(key))
+	{
+		++shared_count;
+		return *found->vao;
+	}
+
+	std::unique_ptr<Entry> entry(new Entry());
+	Fill(key, *entry, generate);
+
+	const PackedMesh& packed = entry->view.packed;
+	if (arena)
+		entry->vao = arena->Allocate(packed);
+	if (!entry->vao)
+		entry->vao.reset(new VAO(packed));
+
+	VAO& vao = *entry->vao;
+	std::lock_guard<std::mutex> lock(entries_mutex);
+	entries[key] = std::move(entry);
+	return vao;
+}
+
+VAO& MeshRegistry::Reserve(const MeshKey& key, bool& reserved)
+{
+	std::lock_guard<std::mutex> lock(entries_mutex);
+	auto found = entries.find(key);
+	reserved = found == entries.end();
+	if (!reserved)
+	{
+		++shared_count;
+		return *found->second->vao;
+	}
+
+	std::unique_ptr<Entry> entry(new Entry());
+	entry->view = MeshView();
+	entry->vao.reset(new VAO());
+	entry->vao->layout = layout;
+	entry->vao->resident = false;
+
+	VAO& vao = *entry->vao;
+	entries[key] = std::move(entry);
+	return vao;
+}
+
+MeshView MeshRegistry::Prepare(const MeshKey& key, const Generator& generate)
+{
+	Entry* entry = Find(key);
+	if (!entry)
+	{
+		std::cout << "Error: Mesh " << key.Name() << " is not reserved" << std::endl;
+		return MeshView();
+	}
+
+	Fill(key, *entry, generate);
+	return entry->view;
+}
+
+MeshView MeshRegistry::View(const MeshKey& key) const
+{
+	Entry* entry = Find(key);
+	if (!entry)
+	{
+		std::cout << "Error: Mesh " << key.Name() << " is not registered" << std::endl;
+		return MeshView();
+	}
+	return entry->view;
+}
+
+std::string MeshRegistry::CachePath(const MeshKey& key) const
+{
+	// optimized and plain orderings, and the packings of each layout, of the same mesh are cached side by side
+	static const char* layout_suffixes[] = { "", "-compact", "-half" };
+	return cache_directory + "/" + key.Name() + (optimize ? "-opt" : "") + layout_suffixes[layout] + ".mesh";
+}
+
+bool MeshRegistry::LoadCacheFile(const MeshKey& key, Entry& entry)
+{
+	if (cache_directory.empty())
+		return false;
+
+	std::unique_ptr<MappedFile> mapping(new MappedFile(CachePath(key)));
+	if (!mapping->data || mapping->size < sizeof(MeshCacheHeader))
+		return false;
+
+	MeshCacheHeader header;
+	std::memcpy(&header, mapping->data, sizeof(header));
+	if (header.magic != mesh_cache_magic || header.version != mesh_cache_version)
+		return false;
+
+	// reject truncated files and files written for another key
+	std::string name = key.Name();
+	if (header.key_length != name.size() || sizeof(header) + name.size() > mapping->size
+		|| std::memcmp(mapping->data + sizeof(header), name.data(), name.size()) != 0)
+		return false;
+	if (size_t(header.positions_offset) + header.vertex_count * sizeof(glm::vec3) > mapping->size
+		|| size_t(header.normals_offset) + header.vertex_count * sizeof(glm::vec3) > mapping->size
+		|| size_t(header.indices_offset) + header.index_count * sizeof(GLuint) > mapping->size)
+		return false;
+
+	// the packed parts must be what this registry's VAOs would upload
+	GLsizeiptr index_size = header.index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	GLsizeiptr vertex_size = header.vertex_count * VertexStride(layout) * (layout == VERTEX_LAYOUT_SEPARATE ? 2 : 1);
+	if (header.layout != uint32_t(layout) || (header.index_type != GL_UNSIGNED_SHORT && header.index_type != GL_UNSIGNED_INT)
+		|| header.packed_vertices_size != uint32_t(vertex_size)
+		|| header.packed_elements_size != uint32_t((header.index_count + header.edge_count + header.strip_count) * index_size)
+		|| size_t(header.packed_vertices_offset) + header.packed_vertices_size > mapping->size
+		|| size_t(header.packed_elements_offset) + header.packed_elements_size > mapping->size)
+		return false;
+
+	entry.view.positions = reinterpret_cast<const glm::vec3*>(mapping->data + header.positions_offset);
+	entry.view.normals = reinterpret_cast<const glm::vec3*>(mapping->data + header.normals_offset);
+	entry.view.vertex_count = GLsizei(header.vertex_count);
+	entry.view.indices = reinterpret_cast<const GLuint*>(mapping->data + header.indices_offset);
+	entry.view.index_count = GLsizei(header.index_count);
+
+	PackedMesh& packed = entry.view.packed;
+	packed.layout = layout;
+	packed.vertex_count = GLsizei(header.vertex_count);
+	packed.index_count = GLsizei(header.index_count);
+	packed.edge_count = GLsizei(header.edge_count);
+	packed.strip_count = GLsizei(header.strip_count);
+	packed.index_type = header.index_type;
+	packed.bounds = header.bounds;
+	packed.vertices = mapping->data + header.packed_vertices_offset;
+	packed.vertices_size = header.packed_vertices_size;
+	packed.elements = mapping->data + header.packed_elements_offset;
+	packed.elements_size = header.packed_elements_size;
+	entry.mapping = std::move(mapping);
+	return true;
+}
+
+void MeshRegistry::WriteCacheFile(const MeshKey& key, const Entry& entry)
+{
+	if (cache_directory.empty())
+		return;
+
+	std::string name = key.Name();
+	const MeshView& view = entry.view;
+	const PackedMesh& packed = view.packed;
+
+	MeshCacheHeader header;
+	header.magic = mesh_cache_magic;
+	header.version = mesh_cache_version;
+	header.key_length = uint32_t(name.size());
+	header.vertex_count = uint32_t(view.vertex_count);
+	header.index_count = uint32_t(view.index_count);
+	header.edge_count = uint32_t(packed.edge_count);
+	header.strip_count = uint32_t(packed.strip_count);
+	header.layout = uint32_t(packed.layout);
+	header.index_type = uint32_t(packed.index_type);
+	header.bounds = packed.bounds;
+	header.positions_offset = AlignTo4(sizeof(header) + name.size());
+	header.normals_offset = header.positions_offset + uint32_t(view.vertex_count * sizeof(glm::vec3));
+	header.indices_offset = header.normals_offset + uint32_t(view.vertex_count * sizeof(glm::vec3));
+	header.packed_vertices_offset = header.indices_offset + uint32_t(view.index_count * sizeof(GLuint));
+	header.packed_vertices_size = uint32_t(packed.vertices_size);
+	header.packed_elements_offset = header.packed_vertices_offset + header.packed_vertices_size;
+	header.packed_elements_size = uint32_t(packed.elements_size);
+
+	// written next to the final name and renamed, so a crash never leaves a half-written cache file
+	std::string path = CachePath(key);
+	std::string temporary_path = path + ".tmp";
+	{
+		std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			std::cout << "Error: Cannot write mesh cache " << temporary_path << std::endl;
+			return;
+		}
+
+		const char padding[4] = { 0, 0, 0, 0 };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(name.data(), name.size());
+		file.write(padding, header.positions_offset - (sizeof(header) + name.size()));
+		file.write(reinterpret_cast<const char*>(view.positions), view.vertex_count * sizeof(glm::vec3));
+		file.write(reinterpret_cast<const char*>(view.normals), view.vertex_count * sizeof(glm::vec3));
+		file.write(reinterpret_cast<const char*>(view.indices), view.index_count * sizeof(GLuint));
+		file.write(reinterpret_cast<const char*>(packed.vertices), packed.vertices_size);
+		file.write(reinterpret_cast<const char*>(packed.elements), packed.elements_size);
+		if (!file)
+		{
+			std::cout << "Error: Cannot write mesh cache " << temporary_path << std::endl;
+			return;
+		}
+	}
+
+	std::remove(path.c_str());
+	std::rename(temporary_path.c_str(), path.c_str());
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include "opengl_utilities.h"
+
+/* Mesh Keys */
+
+// Identifies a generated mesh: which generator, which curve, how many segments.
+struct MeshKey
+{
+	std::string generator;
+	std::string curve;
+	int vertical_segments;
+	int rotation_segments;
+
+	std::string Name() const;
+	bool operator<(const MeshKey& other) const;
+};
+
+/* Mesh Data */
+
+// CPU-side view of a registered mesh, backed either by generated arrays or by a mapped cache file.
+// packed is the same mesh in the registry's layout, as its buffers hold it.
+struct MeshView
+{
+	const glm::vec3* positions;
+	const glm::vec3* normals;
+	GLsizei vertex_count;
+	const GLuint* indices;
+	GLsizei index_count;
+
+	PackedMesh packed;
+};
+
+// Read-only memory map of a whole file, unmapped on destruction.
+struct MappedFile
+{
+	const unsigned char* data;
+	size_t size;
+
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+private:
+#ifdef _WIN32
+	void* file_handle;
+	void* mapping_handle;
+#else
+	int file_descriptor;
+#endif
+};
+
+// Creates one directory level, an existing directory is left as it is.
+void MakeCacheDirectory(const std::string& path);
+
+/* Mesh Registry */
+
+// Hands out one VAO per key. A mesh is generated at most once per process and, with a cache directory,
+// at most once per machine: later launches map the cache file and upload its packed bytes with no parse or copy.
+struct MeshRegistry
+{
+	typedef std::function<void(std::vector<glm::vec3>&, std::vector<glm::vec3>&, std::vector<GLuint>&)> Generator;
+
+	// an empty directory keeps the registry in memory only, every VAO is built with the given layout;
+	// optimize runs generated meshes through OptimizeMesh before they are cached and uploaded;
+	// with an arena, of the same layout, meshes are placed there unless they are too large for it
+	explicit MeshRegistry(const std::string& cache_directory = "", VertexLayout layout = VERTEX_LAYOUT_SEPARATE, bool optimize = false, GeometryArena* arena = nullptr);
+
+	VAO& Get(const MeshKey& key, const Generator& generate);
+	MeshView View(const MeshKey& key) const;
+
+	// Get in two steps, for MeshStreamer. Reserve registers key with an empty VAO that is not resident and sets
+	// reserved, or returns the VAO already registered. Prepare then fills the CPU side of a reserved key from the
+	// cache or generate; workers may prepare different keys at once. The caller uploads the view's packed mesh
+	// into the VAO.
+	// View gives an empty mesh for a reserved key until Prepare has returned.
+	VAO& Reserve(const MeshKey& key, bool& reserved);
+	MeshView Prepare(const MeshKey& key, const Generator& generate);
+
+	VertexLayout Layout() const { return layout; }
+	GeometryArena* Arena() const { return arena; }
+
+	// counted from the workers as well
+	std::atomic<int> generated_count;
+	std::atomic<int> loaded_count;
+	std::atomic<int> shared_count;
+
+private:
+	struct Entry
+	{
+		std::unique_ptr<VAO> vao;
+		MeshView view;
+
+		std::unique_ptr<MappedFile> mapping;
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<GLuint> indices;
+		std::vector<unsigned char> packed_vertices;
+		std::vector<unsigned char> packed_elements;
+	};
+
+	Entry* Find(const MeshKey& key) const;
+	void Fill(const MeshKey& key, Entry& entry, const Generator& generate);
+	bool LoadCacheFile(const MeshKey& key, Entry& entry);
+	void WriteCacheFile(const MeshKey& key, const Entry& entry);
+	std::string CachePath(const MeshKey& key) const;
+
+	std::string cache_directory;
+	VertexLayout layout;
+	bool optimize;
+	GeometryArena* arena;
+	std::map<MeshKey, std::unique_ptr<Entry>> entries;
+	mutable std::mutex entries_mutex; // guards the map only, an entry is filled by one thread
+
+};
@@ -7,187 +7,179 @@ void GenerateParametricShapeFrom2D(
 	std::vector<GLuint>& indices,
 	glm::dvec2(*parametric_line)(double),
 	int vertical_segments,
-	int rotation_segments
+	int rotation_segments,
+	ThreadPool* pool
 )
 {
-	auto parametric_surface = [parametric_line](double t, double r)
-	{
-		auto p = glm::dvec3(parametric_line(t), 0);
-		return glm::rotateY(p, r * glm::two_pi<double>());
-	};
-
-	positions.reserve(vertical_segments * rotation_segments);
-	for (int r = 0; r < rotation_segments; ++r)
-		for (int v = 0; v < vertical_segments; ++v)
-			positions.push_back(parametric_surface(v / double(vertical_segments - 1), r / double(rotation_segments)));
-
-	normals.reserve(vertical_segments * rotation_segments);
-	for (int r = 0; r < rotation_segments; ++r)
-		for (int v = 0; v < vertical_segments; ++v)
-		{
-			auto nv = v / double(vertical_segments - 1);
-			auto nr = r / double(rotation_segments);
-			auto epsilonv = 1 / double(vertical_segments - 1);
-			auto epsilonr = 1 / double(rotation_segments);
-
-			auto to_next_v = parametric_surface(nv + epsilonv, nr) - parametric_surface(nv, nr);
-			auto from_prev_v = parametric_surface(nv, nr) - parametric_surface(nv - epsilonv, nr);
-			auto tangent_v = (to_next_v + from_prev_v) / 2.;
-
-			auto to_next_r = parametric_surface(nv, nr + epsilonr) - parametric_surface(nv, nr);
-			auto from_prev_r = parametric_surface(nv, nr) - parametric_surface(nv, nr - epsilonr);
-			auto tangent_r = (to_next_r + from_prev_r) / 2.;
-
-			auto normal = glm::normalize(glm::cross(tangent_r, tangent_v));
-			normals.push_back(normal);
-		}
-
-	auto VRtoIndex = [vertical_segments, rotation_segments](int v, int r)
-	{
-		return (r % rotation_segments) * vertical_segments + v;
-	};
-	indices.reserve(rotation_segments * (vertical_segments - 1) * 6);
-	for (int r = 0; r < rotation_segments; ++r)
-		for (int v = 0; v < vertical_segments - 1; ++v)
-		{
-			indices.push_back(VRtoIndex(v + 1, r));
-			indices.push_back(VRtoIndex(v, r + 1));
-			indices.push_back(VRtoIndex(v, r));
-
-			indices.push_back(VRtoIndex(v + 1, r));
-			indices.push_back(VRtoIndex(v + 1, r + 1));
-			indices.push_back(VRtoIndex(v, r + 1));
-		}
+	GenerateRevolvedShape<double>(positions, normals, indices, parametric_line, vertical_segments, rotation_segments, pool);
 }
 
 void GenerateParametricShapeFrom2D_2(
-    std::vector<glm::vec3>& positions,
-    std::vector<glm::vec3>& normals,
-    std::vector<GLuint>& indices,
-    glm::dvec2(*parametric_line)(double),
-    int vertical_segments,
-    int rotation_segments
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	glm::dvec2(*parametric_line)(double),
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool
 )
 {
-    auto parametric_surface = [parametric_line](double t, double r)
-    {
-        auto p = glm::dvec3(parametric_line(t), 0);
-        
-        auto s = sin(r* glm::two_pi<double>() * 6) / 2. + 1;
-        p *= s * 0.5;
-        
-        return glm::rotateY(p, r * glm::two_pi<double>());
-    };
-
-    positions.reserve(vertical_segments * rotation_segments);
-    for (int r = 0; r < rotation_segments; ++r)
-        for (int v = 0; v < vertical_segments; ++v)
-            positions.push_back(parametric_surface(v / double(vertical_segments - 1), r / double(rotation_segments)));
-
-    normals.reserve(vertical_segments * rotation_segments);
-    for (int r = 0; r < rotation_segments; ++r)
-        for (int v = 0; v < vertical_segments; ++v)
-        {
-            auto nv = v / double(vertical_segments - 1);
-            auto nr = r / double(rotation_segments);
-            auto epsilonv = 1 / double(vertical_segments - 1);
-            auto epsilonr = 1 / double(rotation_segments);
-
-            auto to_next_v = parametric_surface(nv + epsilonv, nr) - parametric_surface(nv, nr);
-            auto from_prev_v = parametric_surface(nv, nr) - parametric_surface(nv - epsilonv, nr);
-            auto tangent_v = (to_next_v + from_prev_v) / 2.;
-
-            auto to_next_r = parametric_surface(nv, nr + epsilonr) - parametric_surface(nv, nr);
-            auto from_prev_r = parametric_surface(nv, nr) - parametric_surface(nv, nr - epsilonr);
-            auto tangent_r = (to_next_r + from_prev_r) / 2.;
-
-            auto normal = glm::normalize(glm::cross(tangent_r, tangent_v));
-            normals.push_back(normal);
-        }
-
-    auto VRtoIndex = [vertical_segments, rotation_segments](int v, int r)
-    {
-        return (r % rotation_segments) * vertical_segments + v;
-    };
-    indices.reserve(rotation_segments * (vertical_segments - 1) * 6);
-    for (int r = 0; r < rotation_segments; ++r)
-        for (int v = 0; v < vertical_segments - 1; ++v)
-        {
-            indices.push_back(VRtoIndex(v + 1, r));
-            indices.push_back(VRtoIndex(v, r + 1));
-            indices.push_back(VRtoIndex(v, r));
-
-            indices.push_back(VRtoIndex(v + 1, r));
-            indices.push_back(VRtoIndex(v + 1, r + 1));
-            indices.push_back(VRtoIndex(v, r + 1));
-        }
+	GenerateModulatedRevolvedShape<double>(positions, normals, indices, parametric_line, 6., vertical_segments, rotation_segments, pool);
 }
+
 void GenerateParametricShapeFrom3D(
 	std::vector<glm::vec3>& positions,
 	std::vector<glm::vec3>& normals,
 	std::vector<GLuint>& indices,
 	glm::dvec3(*parametric_surface)(double, double),
 	int vertical_segments,
-	int rotation_segments
+	int rotation_segments,
+	ThreadPool* pool
+)
+{
+	GenerateParametricShape<double>(positions, normals, indices, parametric_surface, vertical_segments, rotation_segments, pool);
+}
+
+
+/* Generator Functions With Exact Normals */
+void GenerateParametricShapeFrom2D(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	DualVec2(*parametric_line)(Dual),
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool
+)
+{
+	RevolvedDualSurface<DualVec2(*)(Dual)> surface = { parametric_line };
+	GenerateParametricShape<double>(positions, normals, indices, surface, vertical_segments, rotation_segments, pool);
+}
+
+void GenerateParametricShapeFrom2D_2(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	DualVec2(*parametric_line)(Dual),
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool
+)
+{
+	ModulatedRevolvedDualSurface<DualVec2(*)(Dual)> surface = { parametric_line, 6. };
+	GenerateParametricShape<double>(positions, normals, indices, surface, vertical_segments, rotation_segments, pool);
+}
+
+void GenerateParametricShapeFrom3D(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	DualVec3(*parametric_surface)(Dual, Dual),
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool
+)
+{
+	DualSurfaceNormals<DualVec3(*)(Dual, Dual)> surface = { parametric_surface };
+	GenerateParametricShape<double>(positions, normals, indices, surface, vertical_segments, rotation_segments, pool);
+}
+
+
+/* Adaptive Generator Functions */
+void GenerateAdaptiveShapeFrom2D(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	glm::dvec2(*parametric_line)(double),
+	const AdaptiveTessellation& tessellation,
+	ThreadPool* pool
+)
+{
+	GenerateAdaptiveRevolvedShape<double>(positions, normals, indices, parametric_line, tessellation, pool);
+}
+
+void GenerateAdaptiveShapeFrom2D_2(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	glm::dvec2(*parametric_line)(double),
+	const AdaptiveTessellation& tessellation,
+	ThreadPool* pool
+)
+{
+	GenerateAdaptiveModulatedRevolvedShape<double>(positions, normals, indices, parametric_line, 6., tessellation, pool);
+}
+
+void GenerateAdaptiveShapeFrom2D(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	DualVec2(*parametric_line)(Dual),
+	const AdaptiveTessellation& tessellation,
+	ThreadPool* pool
+)
+{
+	RevolvedDualSurface<DualVec2(*)(Dual)> surface = { parametric_line };
+	auto profile = [&](double t) { return parametric_line(Dual(t)).Value(); };
+	auto position = [&](double t, double r) { return surface(t, r).position; };
+	GenerateAdaptiveSurface<double>(positions, normals, indices, surface, profile, position, tessellation, pool);
+}
+
+void GenerateAdaptiveShapeFrom2D_2(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	DualVec2(*parametric_line)(Dual),
+	const AdaptiveTessellation& tessellation,
+	ThreadPool* pool
 )
 {
-	positions.reserve(vertical_segments * rotation_segments);
-	for (int r = 0; r < rotation_segments; ++r)
-		for (int v = 0; v < vertical_segments; ++v)
-			positions.push_back(parametric_surface(v / double(vertical_segments - 1), r / double(rotation_segments)));
-
-	normals.reserve(vertical_segments * rotation_segments);
-	for (int r = 0; r < rotation_segments; ++r)
-		for (int v = 0; v < vertical_segments; ++v)
-		{
-			auto nv = v / double(vertical_segments - 1);
-			auto nr = r / double(rotation_segments);
-			auto epsilonv = 1 / double(vertical_segments - 1);
-			auto epsilonr = 1 / double(rotation_segments);
-
-			auto to_next_v = parametric_surface(nv + epsilonv, nr) - parametric_surface(nv, nr);
-			auto from_prev_v = parametric_surface(nv, nr) - parametric_surface(nv - epsilonv, nr);
-			auto tangent_v = (to_next_v + from_prev_v) / 2.;
-
-			auto to_next_r = parametric_surface(nv, nr + epsilonr) - parametric_surface(nv, nr);
-			auto from_prev_r = parametric_surface(nv, nr) - parametric_surface(nv, nr - epsilonr);
-			auto tangent_r = (to_next_r + from_prev_r) / 2.;
-
-			auto normal = glm::normalize(glm::cross(tangent_r, tangent_v));
-			normals.push_back(normal);
-		}
-
-	auto VRtoIndex = [vertical_segments, rotation_segments](int v, int r)
+	ModulatedRevolvedDualSurface<DualVec2(*)(Dual)> surface = { parametric_line, 6. };
+	auto profile = [&](double t) { return parametric_line(Dual(t)).Value(); };
+	auto position = [&](double t, double r) { return surface(t, r).position; };
+	GenerateAdaptiveSurface<double>(positions, normals, indices, surface, profile, position, tessellation, pool);
+}
+
+
+/* Profile Samples */
+void SampleProfile(
+	std::vector<glm::vec2>& positions,
+	std::vector<glm::vec2>& normals,
+	DualVec2(*parametric_line)(Dual),
+	int vertical_segments
+)
+{
+	positions.resize(vertical_segments);
+	normals.resize(vertical_segments);
+	for (int v = 0; v < vertical_segments; ++v)
 	{
-		return (r % rotation_segments) * vertical_segments + v;
-	};
-	indices.reserve(rotation_segments * (vertical_segments - 1) * 6);
-	for (int r = 0; r < rotation_segments; ++r)
-		for (int v = 0; v < vertical_segments - 1; ++v)
-		{
-			indices.push_back(VRtoIndex(v + 1, r));
-			indices.push_back(VRtoIndex(v, r + 1));
-			indices.push_back(VRtoIndex(v, r));
-
-			indices.push_back(VRtoIndex(v + 1, r));
-			indices.push_back(VRtoIndex(v + 1, r + 1));
-			indices.push_back(VRtoIndex(v, r + 1));
-		}
+		double t = v / double(vertical_segments - 1);
+		auto p = parametric_line(Dual(t, 1));
+
+		// RevolvedProfileNormal at angle 0 has no z
+		positions[v] = glm::vec2(p.Value());
+		normals[v] = glm::vec2(RevolvedProfileNormal(p.x.value, ProfileTangent(parametric_line, t, p), 0));
+	}
 }
 
 
 /* Example 2D Parametric Functions */
-glm::dvec2 ParametricHalfCircle(double t)
+
+// Written once for double and Dual, the Dual versions also return the exact tangent.
+template<typename T>
+static void HalfCircleProfile(T t, T& x, T& y)
 {
 	// [0, 1]
 	t -= 0.5;
 	// [-0.5, 0.5]
 	t *= glm::pi<double>();
 	// [-PI*0.5, PI*0.5]
-	return glm::dvec2(cos(t), sin(t));
-};
+	x = cos(t);
+	y = sin(t);
+}
 
-glm::dvec2 ParametricCircle(double t)
+template<typename T>
+static void CircleProfile(T t, T& x, T& y)
 {
 	// [0, 1]
 	t -= 0.5;
@@ -197,10 +189,12 @@ glm::dvec2 ParametricCircle(double t)
 
 	auto c = glm::dvec2(0.7, 0);
 	auto r = 0.3;
-	return glm::dvec2(cos(t), sin(t)) * r + c;
-};
+	x = cos(t) * r + c.x;
+	y = sin(t) * r + c.y;
+}
 
-glm::dvec2 ParametricSpikes(double t)
+template<typename T>
+static void SpikesProfile(T t, T& x, T& y)
 {
 	// [0, 1]
 	t -= 0.5;
@@ -211,5 +205,48 @@ glm::dvec2 ParametricSpikes(double t)
 	auto c = glm::dvec2(0.7, 0);
 	auto r = 0.3;
 	auto a = 2 + 4 * 2;
-	return (glm::dvec2(cos(t) + sin(a*t) / a, sin(t) + cos(a*t) / a)) * r + c;
+	x = (cos(t) + sin(double(a) * t) / double(a)) * r + c.x;
+	y = (sin(t) + cos(double(a) * t) / double(a)) * r + c.y;
+}
+
+glm::dvec2 ParametricHalfCircle(double t)
+{
+	glm::dvec2 p;
+	HalfCircleProfile(t, p.x, p.y);
+	return p;
+};
+
+glm::dvec2 ParametricCircle(double t)
+{
+	glm::dvec2 p;
+	CircleProfile(t, p.x, p.y);
+	return p;
+};
+
+glm::dvec2 ParametricSpikes(double t)
+{
+	glm::dvec2 p;
+	SpikesProfile(t, p.x, p.y);
+	return p;
+};
+
+DualVec2 ParametricHalfCircleDual(Dual t)
+{
+	DualVec2 p;
+	HalfCircleProfile(t, p.x, p.y);
+	return p;
+};
+
+DualVec2 ParametricCircleDual(Dual t)
+{
+	DualVec2 p;
+	CircleProfile(t, p.x, p.y);
+	return p;
+};
+
+DualVec2 ParametricSpikesDual(Dual t)
+{
+	DualVec2 p;
+	SpikesProfile(t, p.x, p.y);
+	return p;
 };
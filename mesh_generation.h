@@ -7,14 +7,22 @@
 #include "glm/gtx/rotate_vector.hpp"
 #include "glad/glad.h"
 
+#include "dual.h"
+#include "mesh_generation_core.h"
+#include "thread_pool.h"
+
 /* Generator Functions */
+
+// Instantiations of GenerateParametricShape in mesh_generation_core.h, which also takes lambdas and functors directly.
+// With a pool the rotation rows are generated in parallel, the output is identical either way.
 void GenerateParametricShapeFrom2D(
 	std::vector<glm::vec3>& positions,
 	std::vector<glm::vec3>& normals,
 	std::vector<GLuint>& indices,
 	glm::dvec2(*parametric_line)(double),
 	int vertical_segments,
-	int rotation_segments
+	int rotation_segments,
+	ThreadPool* pool = nullptr
 );
 
 void GenerateParametricShapeFrom2D_2(
@@ -23,7 +31,8 @@ void GenerateParametricShapeFrom2D_2(
     std::vector<GLuint>& indices,
     glm::dvec2(*parametric_line)(double),
     int vertical_segments,
-    int rotation_segments
+    int rotation_segments,
+    ThreadPool* pool = nullptr
 );
 
 void GenerateParametricShapeFrom3D(
@@ -32,10 +41,102 @@ void GenerateParametricShapeFrom3D(
 	std::vector<GLuint>& indices,
 	glm::dvec3(*parametric_surface)(double, double),
 	int vertical_segments,
-	int rotation_segments
+	int rotation_segments,
+	ThreadPool* pool = nullptr
+);
+
+/* Generator Functions With Exact Normals */
+
+// Curves and surfaces evaluated on dual numbers give their tangents along with the position,
+// so normals need no extra evaluations and stay exact at poles and seams.
+void GenerateParametricShapeFrom2D(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	DualVec2(*parametric_line)(Dual),
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool = nullptr
+);
+
+void GenerateParametricShapeFrom2D_2(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	DualVec2(*parametric_line)(Dual),
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool = nullptr
+);
+
+void GenerateParametricShapeFrom3D(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	DualVec3(*parametric_surface)(Dual, Dual),
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool = nullptr
+);
+
+/* Adaptive Generator Functions */
+
+// Instead of segment counts the caller gives an error budget: the profile is sampled densely where it bends
+// and sparsely where it is flat, then the rotation rows likewise (see GenerateAdaptiveSurface).
+void GenerateAdaptiveShapeFrom2D(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	glm::dvec2(*parametric_line)(double),
+	const AdaptiveTessellation& tessellation,
+	ThreadPool* pool = nullptr
+);
+
+void GenerateAdaptiveShapeFrom2D_2(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	glm::dvec2(*parametric_line)(double),
+	const AdaptiveTessellation& tessellation,
+	ThreadPool* pool = nullptr
+);
+
+// With exact normals, which the uneven spacing of adaptive grids would otherwise skew.
+void GenerateAdaptiveShapeFrom2D(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	DualVec2(*parametric_line)(Dual),
+	const AdaptiveTessellation& tessellation,
+	ThreadPool* pool = nullptr
+);
+
+void GenerateAdaptiveShapeFrom2D_2(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	DualVec2(*parametric_line)(Dual),
+	const AdaptiveTessellation& tessellation,
+	ThreadPool* pool = nullptr
+);
+
+/* Profile Samples */
+
+// The vertical_segments profile points, and their normals in the profile plane, that GenerateParametricShapeFrom2D
+// sweeps around Y. Rotating a point and its normal by the angle of a row gives that row's vertex exactly.
+void SampleProfile(
+	std::vector<glm::vec2>& positions,
+	std::vector<glm::vec2>& normals,
+	DualVec2(*parametric_line)(Dual),
+	int vertical_segments
 );
 
 /* Example 2D Parametric Functions */
 glm::dvec2 ParametricHalfCircle(double);
 glm::dvec2 ParametricCircle(double);
 glm::dvec2 ParametricSpikes(double);
+
+/* Example 2D Parametric Functions With Tangents */
+DualVec2 ParametricHalfCircleDual(Dual);
+DualVec2 ParametricCircleDual(Dual);
+DualVec2 ParametricSpikesDual(Dual);
@@ -0,0 +1,482 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+#include "glm/glm.hpp"
+#include "glm/gtc/constants.hpp"
+#include "glm/gtx/rotate_vector.hpp"
+#include "glad/glad.h"
+
+#include "dual.h"
+#include "thread_pool.h"
+
+/* Generator Precision */
+
+// Real picks the type surfaces are evaluated in, output is always float.
+template<typename Real> struct GeneratorVectors;
+template<> struct GeneratorVectors<float> { typedef glm::vec2 vec2; typedef glm::vec3 vec3; };
+template<> struct GeneratorVectors<double> { typedef glm::dvec2 vec2; typedef glm::dvec3 vec3; };
+
+// A surface returning this supplies its own normal, otherwise normals come from central differences.
+template<typename Real>
+struct SurfacePoint
+{
+	typename GeneratorVectors<Real>::vec3 position;
+	typename GeneratorVectors<Real>::vec3 normal;
+};
+
+/* Vertex Evaluation */
+
+template<typename Real, typename Surface, typename Vec3>
+inline void EvaluateSurfaceVertex(
+	const Surface& parametric_surface, Real nv, Real nr, Real epsilonv, Real epsilonr,
+	Vec3& position, Vec3& normal, std::false_type /* surface returns a position */
+)
+{
+	position = parametric_surface(nv, nr);
+
+	auto to_next_v = parametric_surface(nv + epsilonv, nr) - parametric_surface(nv, nr);
+	auto from_prev_v = parametric_surface(nv, nr) - parametric_surface(nv - epsilonv, nr);
+	auto tangent_v = (to_next_v + from_prev_v) / Real(2);
+
+	auto to_next_r = parametric_surface(nv, nr + epsilonr) - parametric_surface(nv, nr);
+	auto from_prev_r = parametric_surface(nv, nr) - parametric_surface(nv, nr - epsilonr);
+	auto tangent_r = (to_next_r + from_prev_r) / Real(2);
+
+	normal = glm::normalize(glm::cross(tangent_r, tangent_v));
+}
+
+template<typename Real, typename Surface, typename Vec3>
+inline void EvaluateSurfaceVertex(
+	const Surface& parametric_surface, Real nv, Real nr, Real, Real,
+	Vec3& position, Vec3& normal, std::true_type /* surface returns a SurfacePoint */
+)
+{
+	auto point = parametric_surface(nv, nr);
+	position = point.position;
+	normal = point.normal;
+}
+
+/* Grid Indices */
+
+// Two triangles per quad of a (vertical_segments x rotation_segments) grid, rows wrap around in r.
+// Writes the indices of rows [row_begin, row_end) into quad_indices, which holds every row.
+inline void FillGridIndices(GLuint* quad_indices, int vertical_segments, int rotation_segments, int row_begin, int row_end)
+{
+	auto VRtoIndex = [vertical_segments, rotation_segments](int v, int r)
+	{
+		return (r % rotation_segments) * vertical_segments + v;
+	};
+
+	for (int r = row_begin; r < row_end; ++r)
+		for (int v = 0; v < vertical_segments - 1; ++v)
+		{
+			GLuint* quad = &quad_indices[(r * (vertical_segments - 1) + v) * 6];
+
+			quad[0] = VRtoIndex(v + 1, r);
+			quad[1] = VRtoIndex(v, r + 1);
+			quad[2] = VRtoIndex(v, r);
+
+			quad[3] = VRtoIndex(v + 1, r);
+			quad[4] = VRtoIndex(v + 1, r + 1);
+			quad[5] = VRtoIndex(v, r + 1);
+		}
+}
+
+/* Generator Core */
+
+// Generates a grid from any callable surface(t, r) at the given parameters, t and r in [0, 1].
+// t_samples run from 0 to 1 inclusive, r_samples start at 0 and stop short of 1 as rows wrap around.
+// The surface is a template parameter so lambdas and functors inline into the vertex loop.
+// Arrays are presized and filled one rotation row at a time, with a pool the rows run in parallel
+// and the output is bit-identical to the serial path.
+template<typename Real = double, typename Surface>
+void GenerateSampledShape(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const Surface& parametric_surface,
+	const std::vector<Real>& t_samples,
+	const std::vector<Real>& r_samples,
+	ThreadPool* pool = nullptr
+)
+{
+	typedef typename GeneratorVectors<Real>::vec3 Vec3;
+	typedef typename std::decay<decltype(parametric_surface(Real(), Real()))>::type SurfaceResult;
+	typedef std::is_same<SurfaceResult, SurfacePoint<Real>> ReturnsPoint;
+
+	int vertical_segments = int(t_samples.size());
+	int rotation_segments = int(r_samples.size());
+
+	size_t position_base = positions.size();
+	size_t normal_base = normals.size();
+	size_t index_base = indices.size();
+	positions.resize(position_base + vertical_segments * rotation_segments);
+	normals.resize(normal_base + vertical_segments * rotation_segments);
+	indices.resize(index_base + rotation_segments * (vertical_segments - 1) * 6);
+
+	auto generate_rows = [&](int row_begin, int row_end)
+	{
+		for (int r = row_begin; r < row_end; ++r)
+		{
+			// central differences step by the spacing to the next sample, the last one by the spacing to its neighbour
+			Real epsilonr = (r + 1 < rotation_segments ? r_samples[r + 1] : Real(1)) - r_samples[r];
+			for (int v = 0; v < vertical_segments; ++v)
+			{
+				Real epsilonv = v + 1 < vertical_segments ? t_samples[v + 1] - t_samples[v] : t_samples[v] - t_samples[v - 1];
+
+				Vec3 position, normal;
+				EvaluateSurfaceVertex(
+					parametric_surface, t_samples[v], r_samples[r],
+					epsilonv, epsilonr, position, normal, ReturnsPoint()
+				);
+				positions[position_base + r * vertical_segments + v] = position;
+				normals[normal_base + r * vertical_segments + v] = normal;
+			}
+		}
+
+		FillGridIndices(&indices[index_base], vertical_segments, rotation_segments, row_begin, row_end);
+	};
+
+	if (pool)
+		pool->ParallelFor(rotation_segments, generate_rows);
+	else
+		generate_rows(0, rotation_segments);
+}
+
+// Uniform (vertical_segments x rotation_segments) grid.
+template<typename Real = double, typename Surface>
+void GenerateParametricShape(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const Surface& parametric_surface,
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool = nullptr
+)
+{
+	std::vector<Real> t_samples(vertical_segments);
+	for (int v = 0; v < vertical_segments; ++v)
+		t_samples[v] = v / Real(vertical_segments - 1);
+
+	std::vector<Real> r_samples(rotation_segments);
+	for (int r = 0; r < rotation_segments; ++r)
+		r_samples[r] = r / Real(rotation_segments);
+
+	GenerateSampledShape<Real>(positions, normals, indices, parametric_surface, t_samples, r_samples, pool);
+}
+
+/* Adaptive Sampling */
+
+// Error budget for the adaptive generators, which sample where the surface bends instead of at a fixed count.
+struct AdaptiveTessellation
+{
+	double max_error = 1e-3;  // largest distance between a chord and the curve it stands for, in object units
+	double max_angle = 0.35;  // largest turn across a chord in radians, checked only on chords longer than max_error
+	int min_segments = 16;    // no step is longer than 1 / min_segments, so no whole feature of the curve is stepped over
+	int max_segments = 4096;  // nor shorter than 1 / max_segments
+};
+
+// Distance from p to the segment a-b.
+template<typename Vec>
+inline double DistanceToSegment(const Vec& p, const Vec& a, const Vec& b)
+{
+	auto ab = b - a;
+	double length_squared = glm::dot(ab, ab);
+	double s = length_squared > 0 ? glm::clamp(glm::dot(p - a, ab) / length_squared, 0., 1.) : 0.;
+	return glm::length(p - (a + ab * s));
+}
+
+// Whether the chord from t0 to t1 stands in for the curve: the curve at the eighth points stays within max_error
+// of it, and chords longer than max_error turn no more than max_angle at the midpoint.
+template<typename Curve>
+bool ChordFitsCurve(const Curve& curve, const AdaptiveTessellation& tessellation, double t0, double t1)
+{
+	typedef typename std::decay<decltype(curve(0.))>::type Vec;
+
+	Vec p0 = curve(t0), p1 = curve(t1);
+	Vec pm = curve((t0 + t1) / 2);
+	for (int i = 1; i < 8; ++i)
+		if (DistanceToSegment(i == 4 ? pm : Vec(curve(t0 + (t1 - t0) * i / 8)), p0, p1) > tessellation.max_error)
+			return false;
+
+	auto first = pm - p0;
+	auto second = p1 - pm;
+	double first_length = glm::length(first), second_length = glm::length(second);
+	if (glm::length(p1 - p0) <= tessellation.max_error || first_length == 0 || second_length == 0)
+		return true;
+	return std::acos(glm::clamp(glm::dot(first, second) / (first_length * second_length), -1., 1.)) <= tessellation.max_angle;
+}
+
+// Parameters in [0, 1] of a curve(t) returning a dvec2 or dvec3, 1 included unless closed.
+// Walks from 0 taking each time the longest step whose chord fits the curve, found by bisection between
+// 1 / max_segments and 1 / min_segments, so flat stretches get few samples and bends get many.
+template<typename Curve>
+std::vector<double> AdaptiveCurveSamples(const Curve& curve, const AdaptiveTessellation& tessellation, bool closed)
+{
+	double shortest = 1. / std::max(tessellation.max_segments, 1);
+	double longest = 1. / std::max(tessellation.min_segments, 1);
+
+	std::vector<double> samples = { 0. };
+	for (double t = 0; t < 1; )
+	{
+		double high = std::min(longest, 1 - t);
+		double low = std::min(shortest, high); // taken even if it misses the budget
+		if (ChordFitsCurve(curve, tessellation, t, t + high))
+			low = high;
+		else
+			while (high - low > shortest / 2)
+			{
+				double step = (low + high) / 2;
+				if (ChordFitsCurve(curve, tessellation, t, t + step))
+					low = step;
+				else
+					high = step;
+			}
+
+		// no sliver at the end
+		t = 1 - (t + low) < shortest ? 1 : t + low;
+		samples.push_back(t);
+	}
+
+	if (closed)
+		samples.pop_back();
+	return samples;
+}
+
+/* Surface Functors */
+
+// Profile curve rotated around the Y axis.
+template<typename Real, typename Profile>
+struct RevolvedSurface
+{
+	typedef typename GeneratorVectors<Real>::vec2 Vec2;
+	typedef typename GeneratorVectors<Real>::vec3 Vec3;
+
+	Profile parametric_line;
+
+	Vec3 operator()(Real t, Real r) const
+	{
+		auto p = Vec3(Vec2(parametric_line(t)), 0);
+		return glm::rotateY(p, r * glm::two_pi<Real>());
+	}
+};
+
+// Revolved profile whose radius follows a sine wave around the axis.
+template<typename Real, typename Profile>
+struct ModulatedRevolvedSurface
+{
+	typedef typename GeneratorVectors<Real>::vec2 Vec2;
+	typedef typename GeneratorVectors<Real>::vec3 Vec3;
+
+	Profile parametric_line;
+	Real frequency;
+
+	Vec3 operator()(Real t, Real r) const
+	{
+		auto p = Vec3(Vec2(parametric_line(t)), 0);
+
+		auto s = std::sin(r * glm::two_pi<Real>() * frequency) / Real(2) + 1;
+		p *= s * Real(0.5);
+
+		return glm::rotateY(p, r * glm::two_pi<Real>());
+	}
+};
+
+// Profile tangent from a Dual evaluation. At a cusp (the tips of ParametricSpikes) the derivative vanishes,
+// there the chord across a small step gives the direction the mesh actually has.
+template<typename DualProfile>
+inline glm::dvec2 ProfileTangent(const DualProfile& parametric_line, double t, const DualVec2& p)
+{
+	auto tangent = p.Derivative();
+	if (glm::dot(tangent, tangent) < 1e-12)
+		tangent = parametric_line(Dual(t + 1e-3)).Value() - parametric_line(Dual(t - 1e-3)).Value();
+	return tangent;
+}
+
+// Normal of a profile point swept around Y, exact even where the profile touches the axis.
+inline glm::dvec3 RevolvedProfileNormal(double radius, const glm::dvec2& tangent, double angle)
+{
+	auto profile_normal = glm::dvec3(tangent.y, -tangent.x, 0);
+	if (radius < 0)
+		profile_normal = -profile_normal;
+	return glm::normalize(glm::rotateY(profile_normal, angle));
+}
+
+// RevolvedSurface over a Dual profile, one evaluation gives position and exact normal.
+template<typename DualProfile>
+struct RevolvedDualSurface
+{
+	DualProfile parametric_line;
+
+	SurfacePoint<double> operator()(double t, double r) const
+	{
+		auto p = parametric_line(Dual(t, 1));
+		auto angle = r * glm::two_pi<double>();
+
+		SurfacePoint<double> point;
+		point.position = glm::rotateY(glm::dvec3(p.Value(), 0), angle);
+		point.normal = RevolvedProfileNormal(p.x.value, ProfileTangent(parametric_line, t, p), angle);
+		return point;
+	}
+};
+
+// ModulatedRevolvedSurface over a Dual profile, the scale is differentiated along r as well.
+template<typename DualProfile>
+struct ModulatedRevolvedDualSurface
+{
+	DualProfile parametric_line;
+	double frequency;
+
+	SurfacePoint<double> operator()(double t, double r) const
+	{
+		auto p = parametric_line(Dual(t, 1));
+		auto angle = r * glm::two_pi<double>();
+
+		// scale and its derivative along r
+		auto s = sin(Dual(r, 1) * glm::two_pi<double>() * frequency) / 2. + 1.;
+		s *= 0.5;
+
+		auto profile = glm::dvec3(p.Value(), 0);
+		auto rotated = glm::rotateY(profile, angle);
+
+		SurfacePoint<double> point;
+		point.position = glm::rotateY(profile * s.value, angle);
+
+		auto profile_tangent = ProfileTangent(parametric_line, t, p);
+		auto tangent_v = glm::rotateY(glm::dvec3(profile_tangent, 0), angle) * s.value;
+		auto tangent_r = rotated * s.derivative
+			+ glm::dvec3(-profile.x * std::sin(angle), 0, -profile.x * std::cos(angle)) * (glm::two_pi<double>() * s.value);
+
+		auto n = glm::cross(tangent_r, tangent_v);
+		if (glm::dot(n, n) > 0)
+			point.normal = glm::normalize(n);
+		else
+			point.normal = RevolvedProfileNormal(p.x.value, profile_tangent, angle);
+		return point;
+	}
+};
+
+// 3D Dual surface, one pass per parameter gives both tangents.
+template<typename DualSurface>
+struct DualSurfaceNormals
+{
+	DualSurface parametric_surface;
+
+	SurfacePoint<double> operator()(double t, double r) const
+	{
+		auto along_v = parametric_surface(Dual(t, 1), Dual(r, 0));
+		auto along_r = parametric_surface(Dual(t, 0), Dual(r, 1));
+
+		SurfacePoint<double> point;
+		point.position = along_v.Value();
+		point.normal = glm::normalize(glm::cross(along_r.Derivative(), along_v.Derivative()));
+		return point;
+	}
+};
+
+/* Callable Generators */
+
+// Any callable profile(t) returning a 2D point, evaluated in Real precision.
+template<typename Real = double, typename Profile>
+void GenerateRevolvedShape(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const Profile& parametric_line,
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool = nullptr
+)
+{
+	RevolvedSurface<Real, Profile> surface = { parametric_line };
+	GenerateParametricShape<Real>(positions, normals, indices, surface, vertical_segments, rotation_segments, pool);
+}
+
+template<typename Real = double, typename Profile>
+void GenerateModulatedRevolvedShape(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const Profile& parametric_line,
+	Real frequency,
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool = nullptr
+)
+{
+	ModulatedRevolvedSurface<Real, Profile> surface = { parametric_line, frequency };
+	GenerateParametricShape<Real>(positions, normals, indices, surface, vertical_segments, rotation_segments, pool);
+}
+
+/* Adaptive Generators */
+
+// Samples the profile against the budget, then the ring swept by the profile sample furthest from the axis,
+// where the chords around r are longest. A plain revolution bends evenly around r, a modulated one gets
+// its rows packed where the sine wave turns. position(t, r) gives the point of the surface being sampled.
+template<typename Real, typename Surface, typename Profile, typename Position>
+void GenerateAdaptiveSurface(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const Surface& surface,
+	const Profile& profile,
+	const Position& position,
+	const AdaptiveTessellation& tessellation,
+	ThreadPool* pool
+)
+{
+	std::vector<double> t_samples = AdaptiveCurveSamples(profile, tessellation, false);
+
+	double widest_t = 0, widest_radius = -1;
+	for (double t : t_samples)
+	{
+		double radius = std::abs(profile(t).x);
+		if (radius > widest_radius)
+		{
+			widest_t = t;
+			widest_radius = radius;
+		}
+	}
+	std::vector<double> r_samples = AdaptiveCurveSamples([&](double r) { return position(widest_t, r); }, tessellation, true);
+
+	GenerateSampledShape<Real>(positions, normals, indices, surface,
+		std::vector<Real>(t_samples.begin(), t_samples.end()), std::vector<Real>(r_samples.begin(), r_samples.end()), pool);
+}
+
+// Any callable profile(t) returning a 2D point, sampled against an error budget instead of segment counts.
+template<typename Real = double, typename Profile>
+void GenerateAdaptiveRevolvedShape(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const Profile& parametric_line,
+	const AdaptiveTessellation& tessellation,
+	ThreadPool* pool = nullptr
+)
+{
+	RevolvedSurface<Real, Profile> surface = { parametric_line };
+	RevolvedSurface<double, Profile> position = { parametric_line };
+	auto profile = [&](double t) { return glm::dvec2(parametric_line(t)); };
+	GenerateAdaptiveSurface<Real>(positions, normals, indices, surface, profile, position, tessellation, pool);
+}
+
+template<typename Real = double, typename Profile>
+void GenerateAdaptiveModulatedRevolvedShape(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const Profile& parametric_line,
+	Real frequency,
+	const AdaptiveTessellation& tessellation,
+	ThreadPool* pool = nullptr
+)
+{
+	ModulatedRevolvedSurface<Real, Profile> surface = { parametric_line, frequency };
+	ModulatedRevolvedSurface<double, Profile> position = { parametric_line, double(frequency) };
+	auto profile = [&](double t) { return glm::dvec2(parametric_line(t)); };
+	GenerateAdaptiveSurface<Real>(positions, normals, indices, surface, profile, position, tessellation, pool);
+}
@@ -0,0 +1,479 @@
+#include "mesh_optimization.h"
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+/* Post-Transform Cache Statistics */
+
+VertexCacheStatistics AnalyzeVertexCache(const std::vector<GLuint>& indices, int vertex_count, int cache_size)
+{
+	// FIFO cache: a vertex is resident while fewer than cache_size misses happened since it was loaded
+	std::vector<int> loaded_at(vertex_count, -1);
+	std::vector<bool> referenced(vertex_count, false);
+	int misses = 0;
+	int referenced_count = 0;
+
+	for (GLuint index : indices)
+	{
+		if (loaded_at[index] < 0 || misses - loaded_at[index] >= cache_size)
+		{
+			loaded_at[index] = misses;
+			++misses;
+		}
+		if (!referenced[index])
+		{
+			referenced[index] = true;
+			++referenced_count;
+		}
+	}
+
+	VertexCacheStatistics statistics;
+	statistics.acmr = indices.empty() ? 0.f : misses / float(indices.size() / 3);
+	statistics.atvr = referenced_count == 0 ? 0.f : misses / float(referenced_count);
+	return statistics;
+}
+
+/* Welding */
+
+WeldStatistics WeldVertices(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	float epsilon
+)
+{
+	WeldStatistics statistics;
+	statistics.vertices_before = int(positions.size());
+	statistics.triangles_before = int(indices.size() / 3);
+
+	auto cell_of = [epsilon](const glm::vec3& p) { return glm::ivec3(glm::floor(p / epsilon)); };
+	auto cell_key = [](const glm::ivec3& cell) {
+		// 21 bits per axis, wrapping is harmless as candidates are compared by distance
+		return (unsigned long long)(cell.x & 0x1FFFFF) << 42 | (unsigned long long)(cell.y & 0x1FFFFF) << 21 | (unsigned long long)(cell.z & 0x1FFFFF);
+	};
+
+	// cell -> welded vertices whose first position lies in it
+	std::unordered_multimap<unsigned long long, GLuint> cells;
+	cells.reserve(positions.size());
+
+	std::vector<GLuint> remap(positions.size());
+	std::vector<glm::vec3> welded_positions;
+	std::vector<glm::vec3> normal_sums;
+	std::vector<glm::vec3> first_normals;
+	float epsilon_squared = epsilon * epsilon;
+
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		const glm::vec3& p = positions[i];
+		glm::ivec3 cell = cell_of(p);
+
+		// a vertex within epsilon lies in this cell or one of its neighbours
+		GLuint found = GLuint(-1);
+		for (int dz = -1; dz <= 1 && found == GLuint(-1); ++dz)
+			for (int dy = -1; dy <= 1 && found == GLuint(-1); ++dy)
+				for (int dx = -1; dx <= 1 && found == GLuint(-1); ++dx)
+				{
+					auto range = cells.equal_range(cell_key(cell + glm::ivec3(dx, dy, dz)));
+					for (auto it = range.first; it != range.second; ++it)
+					{
+						glm::vec3 d = welded_positions[it->second] - p;
+						if (glm::dot(d, d) <= epsilon_squared)
+						{
+							found = it->second;
+							break;
+						}
+					}
+				}
+
+		if (found == GLuint(-1))
+		{
+			found = GLuint(welded_positions.size());
+			welded_positions.push_back(p);
+			normal_sums.push_back(glm::vec3(0));
+			first_normals.push_back(normals[i]);
+			cells.emplace(cell_key(cell), found);
+		}
+		normal_sums[found] += normals[i];
+		remap[i] = found;
+	}
+
+	// triangles that lost an edge to the weld
+	std::vector<GLuint> kept;
+	kept.reserve(indices.size());
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		GLuint a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+		if (a == b || b == c || c == a)
+			continue;
+		kept.push_back(a);
+		kept.push_back(b);
+		kept.push_back(c);
+	}
+
+	// opposite normals, e.g. both sides of a thin shell, cancel out; such a vertex keeps its first normal
+	std::vector<glm::vec3> welded_normals(welded_positions.size());
+	for (size_t i = 0; i < welded_positions.size(); ++i)
+	{
+		float length = glm::length(normal_sums[i]);
+		welded_normals[i] = length > 1e-6f ? normal_sums[i] / length : first_normals[i];
+	}
+
+	positions.swap(welded_positions);
+	normals.swap(welded_normals);
+	indices.swap(kept);
+	OptimizeVertexFetch(positions, normals, indices);
+
+	statistics.vertices_after = int(positions.size());
+	statistics.triangles_after = int(indices.size() / 3);
+	return statistics;
+}
+
+/* Index Optimization */
+
+void OptimizeVertexCache(std::vector<GLuint>& indices, int vertex_count, int cache_size, std::vector<int>* clusters)
+{
+	int triangle_count = int(indices.size() / 3);
+
+	// vertex -> triangles adjacency in compressed rows
+	std::vector<int> adjacency_offsets(vertex_count + 1, 0);
+	for (GLuint index : indices)
+		++adjacency_offsets[index + 1];
+	for (int v = 0; v < vertex_count; ++v)
+		adjacency_offsets[v + 1] += adjacency_offsets[v];
+	std::vector<int> adjacency(indices.size());
+	std::vector<int> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+	for (int t = 0; t < triangle_count; ++t)
+		for (int k = 0; k < 3; ++k)
+			adjacency[fill[indices[t * 3 + k]]++] = t;
+
+	std::vector<int> live_triangles(vertex_count);
+	for (int v = 0; v < vertex_count; ++v)
+		live_triangles[v] = adjacency_offsets[v + 1] - adjacency_offsets[v];
+
+	std::vector<int> cache_time(vertex_count, 0);
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<int> dead_end;
+	std::vector<int> candidates;
+	std::vector<GLuint> output;
+	output.reserve(indices.size());
+
+	int time_stamp = cache_size + 1;
+	int cursor = 0;
+	int fanning = triangle_count > 0 ? int(indices[0]) : -1;
+	if (clusters && fanning >= 0)
+		clusters->push_back(0);
+
+	while (fanning >= 0)
+	{
+		candidates.clear();
+		for (int a = adjacency_offsets[fanning]; a < adjacency_offsets[fanning + 1]; ++a)
+		{
+			int t = adjacency[a];
+			if (emitted[t])
+				continue;
+
+			for (int k = 0; k < 3; ++k)
+			{
+				int v = int(indices[t * 3 + k]);
+				output.push_back(GLuint(v));
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				--live_triangles[v];
+				if (time_stamp - cache_time[v] > cache_size)
+					cache_time[v] = time_stamp++;
+			}
+			emitted[t] = true;
+		}
+
+		// prefer a candidate that is still in the cache and will stay there while its fan is emitted
+		int next = -1;
+		int best_priority = -1;
+		for (int v : candidates)
+		{
+			if (live_triangles[v] <= 0)
+				continue;
+
+			int priority = 0;
+			if (time_stamp - cache_time[v] + 2 * live_triangles[v] <= cache_size)
+				priority = time_stamp - cache_time[v];
+			if (priority > best_priority)
+			{
+				best_priority = priority;
+				next = v;
+			}
+		}
+
+		if (next < 0)
+		{
+			// dead end: back up to a recently used vertex, or jump ahead, which starts a new cluster
+			while (!dead_end.empty() && next < 0)
+			{
+				int v = dead_end.back();
+				dead_end.pop_back();
+				if (live_triangles[v] > 0)
+					next = v;
+			}
+			while (next < 0 && cursor < vertex_count)
+			{
+				if (live_triangles[cursor] > 0)
+				{
+					next = cursor;
+					if (clusters)
+						clusters->push_back(int(output.size() / 3));
+				}
+				++cursor;
+			}
+		}
+
+		fanning = next;
+	}
+
+	indices.swap(output);
+}
+
+void OptimizeOverdraw(
+	std::vector<GLuint>& indices,
+	const std::vector<glm::vec3>& positions,
+	const std::vector<int>& clusters,
+	int cache_size,
+	float threshold
+)
+{
+	int triangle_count = int(indices.size() / 3);
+	if (triangle_count == 0)
+		return;
+
+	// soft boundaries: cut a cluster once the running ACMR of the current piece drops below
+	// threshold times the ACMR of the whole cluster, so each piece pays for its own cache warm-up
+	std::vector<int> boundaries;
+	for (size_t c = 0; c < clusters.size(); ++c)
+	{
+		int begin = clusters[c];
+		int end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+
+		std::vector<GLuint> cluster_indices(indices.begin() + begin * 3, indices.begin() + end * 3);
+		float cluster_acmr = AnalyzeVertexCache(cluster_indices, int(positions.size()), cache_size).acmr;
+
+		boundaries.push_back(begin);
+		std::unordered_map<GLuint, int> loaded_at;
+		int misses = 0;
+		int start = begin;
+		for (int t = begin; t < end; ++t)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				GLuint v = indices[t * 3 + k];
+				auto found = loaded_at.find(v);
+				if (found == loaded_at.end() || misses - found->second >= cache_size)
+				{
+					loaded_at[v] = misses;
+					++misses;
+				}
+			}
+
+			if (t + 1 < end && misses / float(t + 1 - start) < threshold * cluster_acmr)
+			{
+				boundaries.push_back(t + 1);
+				start = t + 1;
+				misses = 0;
+				loaded_at.clear();
+			}
+		}
+	}
+
+	glm::vec3 mesh_center(0);
+	for (const auto& p : positions)
+		mesh_center += p;
+	mesh_center /= float(positions.size());
+
+	struct Cluster
+	{
+		int begin;
+		int end;
+		float sort_key;
+	};
+	std::vector<Cluster> sorted;
+	for (size_t b = 0; b < boundaries.size(); ++b)
+	{
+		Cluster cluster;
+		cluster.begin = boundaries[b];
+		cluster.end = b + 1 < boundaries.size() ? boundaries[b + 1] : triangle_count;
+
+		// area weighted centroid and normal of the cluster
+		glm::vec3 center(0);
+		glm::vec3 normal(0);
+		float area = 0;
+		for (int t = cluster.begin; t < cluster.end; ++t)
+		{
+			const glm::vec3& a = positions[indices[t * 3 + 0]];
+			const glm::vec3& b = positions[indices[t * 3 + 1]];
+			const glm::vec3& c = positions[indices[t * 3 + 2]];
+			glm::vec3 n = glm::cross(b - a, c - a);
+			float triangle_area = glm::length(n);
+			center += (a + b + c) * (triangle_area / 3.f);
+			normal += n;
+			area += triangle_area;
+		}
+		if (area > 0)
+			center /= area;
+
+		cluster.sort_key = glm::dot(center - mesh_center, normal);
+		sorted.push_back(cluster);
+	}
+
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sort_key > b.sort_key; });
+
+	std::vector<GLuint> output;
+	output.reserve(indices.size());
+	for (const auto& cluster : sorted)
+		output.insert(output.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+	indices.swap(output);
+}
+
+void OptimizeVertexFetch(std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices)
+{
+	const GLuint unused = 0xFFFFFFFF;
+	std::vector<GLuint> remap(positions.size(), unused);
+	GLuint next = 0;
+	for (GLuint& index : indices)
+	{
+		if (remap[index] == unused)
+			remap[index] = next++;
+		index = remap[index];
+	}
+
+	std::vector<glm::vec3> new_positions(next);
+	std::vector<glm::vec3> new_normals(next);
+	for (size_t v = 0; v < remap.size(); ++v)
+		if (remap[v] != unused)
+		{
+			new_positions[remap[v]] = positions[v];
+			new_normals[remap[v]] = normals[v];
+		}
+	positions.swap(new_positions);
+	normals.swap(new_normals);
+}
+
+void OptimizeMesh(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const char* name,
+	int cache_size
+)
+{
+	auto weld = WeldVertices(positions, normals, indices);
+	if (name)
+		std::cout << name << ": welded " << weld.vertices_before << " -> " << weld.vertices_after << " vertices, "
+		          << weld.triangles_before << " -> " << weld.triangles_after << " triangles" << std::endl;
+
+	auto before = name ? AnalyzeVertexCache(indices, int(positions.size()), cache_size) : VertexCacheStatistics();
+
+	std::vector<int> clusters;
+	OptimizeVertexCache(indices, int(positions.size()), cache_size, &clusters);
+	OptimizeOverdraw(indices, positions, clusters, cache_size);
+	OptimizeVertexFetch(positions, normals, indices);
+
+	if (!name)
+		return;
+	auto after = AnalyzeVertexCache(indices, int(positions.size()), cache_size);
+	std::cout << name << ": ACMR " << before.acmr << " -> " << after.acmr
+	          << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+}
+
+/* Triangle Strips */
+
+std::vector<GLuint> GenerateTriangleStrips(const std::vector<GLuint>& indices, int vertex_count)
+{
+	int triangle_count = int(indices.size() / 3);
+
+	// directed edge (a -> b, in winding order) -> triangle that contains it
+	auto edge_key = [vertex_count](GLuint a, GLuint b) { return (unsigned long long)a * vertex_count + b; };
+	std::unordered_map<unsigned long long, int> edge_triangle;
+	edge_triangle.reserve(indices.size());
+	for (int t = 0; t < triangle_count; ++t)
+		for (int k = 0; k < 3; ++k)
+			edge_triangle[edge_key(indices[t * 3 + k], indices[t * 3 + (k + 1) % 3])] = t;
+
+	std::vector<bool> used(triangle_count, false);
+	std::vector<GLuint> strips;
+	strips.reserve(indices.size());
+
+	// next unused triangle holding directed edge a -> b, with its third vertex
+	auto find_next = [&](GLuint a, GLuint b, GLuint& third) -> int
+	{
+		auto found = edge_triangle.find(edge_key(a, b));
+		if (found == edge_triangle.end() || used[found->second])
+			return -1;
+		int t = found->second;
+		for (int k = 0; k < 3; ++k)
+		{
+			GLuint v = indices[t * 3 + k];
+			if (v != a && v != b)
+				third = v;
+		}
+		return t;
+	};
+
+	for (int start = 0; start < triangle_count; ++start)
+	{
+		if (used[start])
+			continue;
+
+		if (!strips.empty())
+			strips.push_back(primitive_restart_index);
+
+		used[start] = true;
+		size_t strip_begin = strips.size();
+		strips.push_back(indices[start * 3 + 0]);
+		strips.push_back(indices[start * 3 + 1]);
+		strips.push_back(indices[start * 3 + 2]);
+
+		// strip triangle i is (s[i], s[i+1], s[i+2]) when i is even and (s[i+1], s[i], s[i+2]) when odd
+		for (size_t i = 1;; ++i)
+		{
+			GLuint a = strips[strip_begin + i];
+			GLuint b = strips[strip_begin + i + 1];
+			GLuint third;
+			int t = i % 2 == 0 ? find_next(a, b, third) : find_next(b, a, third);
+			if (t < 0)
+				break;
+
+			used[t] = true;
+			strips.push_back(third);
+		}
+	}
+
+	return strips;
+}
+
+/* Wireframe Edges */
+
+std::vector<GLuint> GenerateEdgeIndices(const GLuint* indices, size_t index_count)
+{
+	std::vector<GLuint> edges;
+	std::unordered_set<unsigned long long> seen;
+	seen.reserve(index_count);
+
+	for (size_t t = 0; t + 2 < index_count; t += 3)
+	{
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			GLuint a = indices[t + corner];
+			GLuint b = indices[t + (corner + 1) % 3];
+			if (a == b)
+				continue;
+
+			// the same key from either side, so an edge shared by two triangles is kept once
+			unsigned long long key = (unsigned long long)std::min(a, b) << 32 | std::max(a, b);
+			if (!seen.insert(key).second)
+				continue;
+
+			edges.push_back(a);
+			edges.push_back(b);
+		}
+	}
+	return edges;
+}
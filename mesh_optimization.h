@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "glad/glad.h"
+
+/* Post-Transform Cache Statistics */
+
+struct VertexCacheStatistics
+{
+	float acmr; // cache misses per triangle, 0.5 is the ideal for large grids, 3 the worst
+	float atvr; // cache misses per referenced vertex, 1 is the ideal
+};
+
+// Simulates a FIFO post-transform cache of cache_size entries over a triangle list.
+VertexCacheStatistics AnalyzeVertexCache(const std::vector<GLuint>& indices, int vertex_count, int cache_size = 16);
+
+/* Welding */
+
+struct WeldStatistics
+{
+	int vertices_before;
+	int vertices_after;
+	int triangles_before;
+	int triangles_after;
+};
+
+// Merges vertices within epsilon of each other, found through a spatial hash of epsilon-sized cells,
+// and gives each merged vertex the normalized sum of their normals. Then drops the triangles welding
+// made degenerate, such as the ones touching the pole rows of a revolved half circle, and any vertex
+// no triangle uses. Indices are remapped, vertices keep their first-seen order.
+WeldStatistics WeldVertices(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	float epsilon = 1e-5f
+);
+
+/* Index Optimization */
+
+// Tipsify (Sander, Nehab and Barczak 2007): reorders triangles for a cache of cache_size entries.
+// Appends the first triangle of every cluster, split wherever the order had to jump, to clusters if given.
+void OptimizeVertexCache(std::vector<GLuint>& indices, int vertex_count, int cache_size = 16, std::vector<int>* clusters = nullptr);
+
+// Splits the Tipsify clusters into pieces whose ACMR stays within threshold of their cluster's, then draws
+// pieces facing away from the mesh centre first so they occlude the rest. Lower thresholds split less.
+void OptimizeOverdraw(
+	std::vector<GLuint>& indices,
+	const std::vector<glm::vec3>& positions,
+	const std::vector<int>& clusters,
+	int cache_size = 16,
+	float threshold = 1.0f
+);
+
+// Renumbers vertices in the order the index buffer first uses them, so vertex fetches stream forward.
+// Vertices no triangle uses are dropped.
+void OptimizeVertexFetch(std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<GLuint>& indices);
+
+// Welding, then the cache, overdraw and fetch passes in sequence. Prints what welding saved and ACMR and ATVR
+// before and after under name, a null name skips the statistics and prints nothing.
+void OptimizeMesh(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const char* name,
+	int cache_size = 16
+);
+
+/* Triangle Strips */
+
+// Separates strips in strip index buffers. A 16-bit index buffer keeps it as 0xFFFF, the VAO narrows
+// indices only for meshes below that many vertices.
+const GLuint primitive_restart_index = 0xFFFFFFFF;
+
+// Greedy strips over a triangle list that keep every triangle's winding, joined by primitive_restart_index.
+// Draw with GL_TRIANGLE_STRIP and GL_PRIMITIVE_RESTART enabled, every VAO keeps them after its edges.
+std::vector<GLuint> GenerateTriangleStrips(const std::vector<GLuint>& indices, int vertex_count);
+
+/* Wireframe Edges */
+
+// Every edge of a triangle list once, as GL_LINES pairs in the order the triangles first use them.
+// Edges are matched through a hash of their sorted endpoints, degenerate edges are left out.
+std::vector<GLuint> GenerateEdgeIndices(const GLuint* indices, size_t index_count);
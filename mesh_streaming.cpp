@@ -0,0 +1,255 @@
+#include "mesh_streaming.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "profiler.h"
+
+/* Mesh Streaming */
+
+// the ring holds this many frames of uploads, so the GPU has that long to finish a frame's copies
+static const int staging_frames = 4;
+
+MeshStreamer::MeshStreamer(MeshRegistry& meshes, ThreadPool& pool, GLsizeiptr frame_budget)
+	: requested_count(0), resident_count(0), streamed_bytes(0), upload_frames(0),
+	  meshes(meshes), pool(pool), frame_budget(std::max<GLsizeiptr>(frame_budget, 1)),
+	  staging_buffer(0), staging_size(this->frame_budget * staging_frames), staging_head(0), staging_used(0),
+	  copy_index(0), copy_done(0), stopping(false)
+{
+	glGenBuffers(1, &staging_buffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, staging_buffer);
+	glBufferData(GL_COPY_READ_BUFFER, staging_size, nullptr, GL_STREAM_DRAW);
+
+	loader = std::thread(&MeshStreamer::LoaderLoop, this);
+}
+
+MeshStreamer::~MeshStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		queued.clear();
+	}
+	wake.notify_all();
+	loader.join();
+
+	for (const Region& region : regions)
+		glDeleteSync(region.fence);
+	glDeleteBuffers(1, &staging_buffer);
+}
+
+VAO& MeshStreamer::Request(const MeshKey& key, const MeshRegistry::Generator& generate)
+{
+	bool reserved;
+	VAO& vao = meshes.Reserve(key, reserved);
+	if (!reserved)
+		return vao;
+
+	++requested_count;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(Job{ key, generate, &vao });
+	}
+	wake.notify_one();
+	return vao;
+}
+
+void MeshStreamer::LoaderLoop()
+{
+	SetProfilerThreadName("Mesh loader");
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return !queued.empty() || stopping; });
+			if (stopping)
+				return;
+		}
+
+		// every thread of the pool takes jobs until none are left, requests made meanwhile are picked up too
+		pool.ParallelFor(pool.ThreadCount(), [this](int, int) {
+			for (;;)
+			{
+				Job job;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (queued.empty())
+						return;
+					job = std::move(queued.front());
+					queued.pop_front();
+				}
+				Prepare(job);
+			}
+		});
+	}
+}
+
+void MeshStreamer::Prepare(const Job& job)
+{
+	PROFILE_ZONE("Prepare streamed mesh");
+
+	std::unique_ptr<Packed> mesh(new Packed());
+	mesh->vao = job.vao;
+	mesh->mesh = meshes.Prepare(job.key, job.generate).packed;
+	mesh->first_vertex = 0;
+	mesh->first_index = 0;
+
+	// the registry packs as GeometryArena::Allocate writes, so the GL thread only copies bytes
+	mesh->arena = meshes.Arena();
+	if (mesh->mesh.index_type != GL_UNSIGNED_SHORT || (mesh->arena && mesh->arena->layout != mesh->mesh.layout))
+		mesh->arena = nullptr;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	ready.push_back(std::move(mesh));
+}
+
+bool MeshStreamer::Begin(Packed& mesh)
+{
+	GeometryArena* arena = mesh.arena;
+	if (!arena)
+		return false;
+
+	const PackedMesh& packed = mesh.mesh;
+	if (!arena->Reserve(packed.vertex_count, packed.index_count + packed.edge_count + packed.strip_count, mesh.first_vertex, mesh.first_index))
+		return false;
+
+	copies.clear();
+	copy_index = 0;
+	copy_done = 0;
+
+	GLintptr vertex_offset = mesh.first_vertex * VertexStride(arena->layout);
+	if (arena->layout == VERTEX_LAYOUT_SEPARATE)
+	{
+		GLsizeiptr half = packed.vertices_size / 2;
+		copies.push_back(Copy{ &arena->position_buffer, vertex_offset, packed.vertices, half });
+		copies.push_back(Copy{ &arena->normals_buffer, vertex_offset, packed.vertices + half, half });
+	}
+	else
+		copies.push_back(Copy{ &arena->position_buffer, vertex_offset, packed.vertices, packed.vertices_size });
+	copies.push_back(Copy{ &arena->element_array_buffer, GLintptr(mesh.first_index * sizeof(GLushort)), packed.elements, packed.elements_size });
+
+	// an empty part would never make progress in Upload
+	copies.erase(std::remove_if(copies.begin(), copies.end(), [](const Copy& copy) { return copy.size == 0; }), copies.end());
+	return true;
+}
+
+void MeshStreamer::Finish(Packed& mesh)
+{
+	VAO& vao = *mesh.vao;
+	const PackedMesh& packed = mesh.mesh;
+	if (mesh.arena)
+	{
+		vao.id = mesh.arena->id;
+		vao.layout = mesh.arena->layout;
+		vao.vertex_count = packed.vertex_count;
+		vao.element_array_count = packed.index_count;
+		vao.edge_count = packed.edge_count;
+		vao.strip_count = packed.strip_count;
+		vao.index_type = GL_UNSIGNED_SHORT;
+		vao.arena = mesh.arena;
+		vao.base_vertex = mesh.first_vertex;
+		vao.first_index = mesh.first_index;
+	}
+	else
+		vao = VAO(packed);
+
+	vao.bounds = packed.bounds;
+	vao.resident = true;
+	++resident_count;
+}
+
+int MeshStreamer::Upload()
+{
+	PROFILE_ZONE("Stream meshes");
+
+	// fences pass in order, the first one still pending ends the retiring
+	while (!regions.empty())
+	{
+		GLenum status = glClientWaitSync(regions.front().fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(regions.front().fence);
+		staging_used -= regions.front().size;
+		regions.pop_front();
+	}
+
+	int became_resident = 0;
+	GLsizeiptr budget = frame_budget;
+	GLsizeiptr frame_size = 0;
+
+	for (;;)
+	{
+		if (!current)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (ready.empty())
+					break;
+				current = std::move(ready.front());
+				ready.pop_front();
+			}
+			if (!Begin(*current))
+			{
+				copies.clear();
+				copy_index = 0;
+			}
+		}
+
+		if (copy_index == copies.size())
+		{
+			Finish(*current);
+			current.reset();
+			++became_resident;
+			continue;
+		}
+
+		// pieces go wherever the ring has room, a mesh may be split over many of them and many frames
+		if (staging_head == staging_size)
+			staging_head = 0;
+		GLsizeiptr contiguous = std::min(staging_size - staging_used, staging_size - staging_head);
+		const Copy& copy = copies[copy_index];
+		GLsizeiptr size = std::min(std::min(copy.size - copy_done, budget), contiguous);
+		if (size <= 0)
+			break;
+
+		// the fences keep the GPU off this range, so the map need not synchronize; bound again each time
+		// as growing the arena uses the same target
+		glBindBuffer(GL_COPY_READ_BUFFER, staging_buffer);
+		void* staging = glMapBufferRange(GL_COPY_READ_BUFFER, staging_head, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (!staging)
+		{
+			std::cout << "Error: Cannot map the mesh staging buffer" << std::endl;
+			break;
+		}
+		std::memcpy(staging, copy.data + copy_done, size);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, *copy.buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, staging_head, copy.offset + copy_done, size);
+
+		staging_head += size;
+		staging_used += size;
+		frame_size += size;
+		streamed_bytes += size;
+		budget -= size;
+		copy_done += size;
+		if (copy_done == copy.size)
+		{
+			++copy_index;
+			copy_done = 0;
+		}
+	}
+
+	if (frame_size > 0)
+	{
+		regions.push_back(Region{ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frame_size });
+		++upload_frames;
+	}
+	return became_resident;
+}
+
+bool MeshStreamer::Finished() const
+{
+	return resident_count == requested_count && regions.empty();
+}
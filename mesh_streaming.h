@@ -0,0 +1,116 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include "mesh_cache.h"
+#include "opengl_utilities.h"
+#include "thread_pool.h"
+
+/* Mesh Streaming */
+
+// Loads registry meshes without blocking the GL thread. Request returns a VAO at once, not resident yet.
+// Workers of the pool load the mesh's packed vertices and 16-bit elements from the cache, or generate, optimize
+// and pack it; Upload, called once per frame on the GL thread, copies at most frame_budget bytes of them into a
+// mapped staging ring and from there into the registry's arena with glCopyBufferSubData. Each frame's part of
+// the ring is fenced and only reused once the GPU has passed the fence, so mapping never waits. A mesh can be
+// drawn as soon as its last copy is issued, later GL commands see the copied data.
+// Meshes too large for the arena, or requested from a registry without one, get a VAO of their own in one go.
+struct MeshStreamer
+{
+	// generators run on the pool's workers, a generator must not call ParallelFor on the same pool
+	MeshStreamer(MeshRegistry& meshes, ThreadPool& pool, GLsizeiptr frame_budget = 256 << 10);
+	// deletes the fences and the staging ring, so the context must still be current
+	~MeshStreamer();
+
+	MeshStreamer(const MeshStreamer&) = delete;
+	MeshStreamer& operator=(const MeshStreamer&) = delete;
+
+	// Registers key and queues it, meshes are prepared roughly in request order. A key registered before
+	// returns its VAO unchanged.
+	VAO& Request(const MeshKey& key, const MeshRegistry::Generator& generate);
+
+	// Retires the staging space of fenced frames the GPU has finished, then uploads up to the budget.
+	// Returns the number of meshes that became resident.
+	int Upload();
+
+	// Every requested mesh is resident and the GPU has finished copying all of them.
+	bool Finished() const;
+
+	int requested_count;
+	int resident_count;
+	long long streamed_bytes; // through the staging ring
+	int upload_frames;        // calls to Upload that copied anything
+
+private:
+	// A prepared mesh, ready to be copied. The bytes stay with the registry.
+	struct Packed
+	{
+		VAO* vao;
+		PackedMesh mesh;
+		GeometryArena* arena; // null when the mesh gets a VAO of its own
+		GLsizei first_vertex;
+		GLsizei first_index;
+	};
+
+	struct Job
+	{
+		MeshKey key;
+		MeshRegistry::Generator generate;
+		VAO* vao;
+	};
+
+	// Part of a packed mesh headed for one buffer, buffer names are read at copy time as the arena may grow.
+	struct Copy
+	{
+		GLuint* buffer;
+		GLintptr offset; // in the buffer
+		const unsigned char* data;
+		GLsizeiptr size;
+	};
+
+	// Staging space written during one frame, free again once its fence is signalled.
+	struct Region
+	{
+		GLsync fence;
+		GLsizeiptr size;
+	};
+
+	void LoaderLoop();
+	void Prepare(const Job& job);
+
+	// Reserves the mesh's arena ranges and lists its copies, false when it does not go through staging.
+	bool Begin(Packed& mesh);
+	void Finish(Packed& mesh);
+
+	MeshRegistry& meshes;
+	ThreadPool& pool;
+	GLsizeiptr frame_budget;
+
+	// staging ring, staging_frames budgets deep
+	GLuint staging_buffer;
+	GLsizeiptr staging_size;
+	GLsizeiptr staging_head;
+	GLsizeiptr staging_used;
+	std::deque<Region> regions;
+
+	// the mesh being copied, taken from ready
+	std::unique_ptr<Packed> current;
+	std::vector<Copy> copies;
+	size_t copy_index;
+	GLsizeiptr copy_done; // bytes of copies[copy_index] already copied
+
+	std::thread loader;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Job> queued;
+	std::deque<std::unique_ptr<Packed>> ready;
+	bool stopping;
+};
@@ -1,42 +1,1150 @@
 #include "opengl_utilities.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "glm/gtc/packing.hpp"
+
+#include "mesh_optimization.h"
+#include "profiler.h"
+#include "program_cache.h"
+
 /* OpenGL Utility Structs */
 
+/* Compact Vertex Formats */
+
+struct CompactVertex
+{
+	glm::vec3 position;
+	uint32_t normal; // GL_INT_2_10_10_10_REV
+};
+
+struct CompactHalfVertex
+{
+	uint16_t position[3]; // GL_HALF_FLOAT
+	uint16_t padding;
+	uint32_t normal; // GL_INT_2_10_10_10_REV
+};
+
+static uint32_t PackNormal(const glm::vec3& normal)
+{
+	return glm::packSnorm3x10_1x2(glm::vec4(normal, 0));
+}
+
+static std::vector<CompactVertex> InterleaveCompact(const glm::vec3* positions, const glm::vec3* normals, GLsizei vertex_count)
+{
+	std::vector<CompactVertex> vertices(vertex_count);
+	for (GLsizei i = 0; i < vertex_count; ++i)
+	{
+		vertices[i].position = positions[i];
+		vertices[i].normal = PackNormal(normals[i]);
+	}
+	return vertices;
+}
+
+static std::vector<CompactHalfVertex> InterleaveCompactHalf(const glm::vec3* positions, const glm::vec3* normals, GLsizei vertex_count)
+{
+	std::vector<CompactHalfVertex> vertices(vertex_count);
+	for (GLsizei i = 0; i < vertex_count; ++i)
+	{
+		vertices[i].position[0] = glm::packHalf1x16(positions[i].x);
+		vertices[i].position[1] = glm::packHalf1x16(positions[i].y);
+		vertices[i].position[2] = glm::packHalf1x16(positions[i].z);
+		vertices[i].padding = 0;
+		vertices[i].normal = PackNormal(normals[i]);
+	}
+	return vertices;
+}
+
+/* Bounding Volumes */
+
+BoundingVolume ComputeBoundingVolume(const glm::vec3* positions, GLsizei vertex_count)
+{
+	BoundingVolume bounds;
+	bounds.min = bounds.max = vertex_count > 0 ? positions[0] : glm::vec3(0);
+	for (GLsizei i = 1; i < vertex_count; ++i)
+	{
+		bounds.min = glm::min(bounds.min, positions[i]);
+		bounds.max = glm::max(bounds.max, positions[i]);
+	}
+
+	bounds.center = (bounds.min + bounds.max) * 0.5f;
+	float radius_squared = 0;
+	for (GLsizei i = 0; i < vertex_count; ++i)
+	{
+		glm::vec3 d = positions[i] - bounds.center;
+		radius_squared = std::max(radius_squared, glm::dot(d, d));
+	}
+	bounds.radius = std::sqrt(radius_squared);
+	return bounds;
+}
+
+/* Vertex Uploads */
+
+static const GLuint position_location = 0;
+static const GLuint normal_location = 1;
+
+GLsizeiptr VertexStride(VertexLayout layout)
+{
+	switch (layout)
+	{
+	case VERTEX_LAYOUT_COMPACT:
+		return sizeof(CompactVertex);
+	case VERTEX_LAYOUT_COMPACT_HALF:
+		return sizeof(CompactHalfVertex);
+	default:
+		return sizeof(glm::vec3);
+	}
+}
+
+// What a vertex buffer of the layout holds for these vertices, the separate layout's two one after the other.
+static std::vector<unsigned char> PackVertices(VertexLayout layout, const glm::vec3* positions, const glm::vec3* normals, GLsizei vertex_count)
+{
+	std::vector<unsigned char> bytes;
+	if (layout == VERTEX_LAYOUT_SEPARATE)
+	{
+		size_t size = vertex_count * sizeof(glm::vec3);
+		bytes.resize(size * 2);
+		if (vertex_count > 0)
+		{
+			std::memcpy(bytes.data(), positions, size);
+			std::memcpy(bytes.data() + size, normals, size);
+		}
+	}
+	else if (layout == VERTEX_LAYOUT_COMPACT)
+	{
+		auto vertices = InterleaveCompact(positions, normals, vertex_count);
+		bytes.resize(vertices.size() * sizeof(CompactVertex));
+		std::memcpy(bytes.data(), vertices.data(), bytes.size());
+	}
+	else
+	{
+		auto vertices = InterleaveCompactHalf(positions, normals, vertex_count);
+		bytes.resize(vertices.size() * sizeof(CompactHalfVertex));
+		std::memcpy(bytes.data(), vertices.data(), bytes.size());
+	}
+	return bytes;
+}
+
+// Writes vertices first onwards into buffers sized beforehand, through the copy target so no vertex array changes.
+static void WriteVertices(
+	VertexLayout layout,
+	GLuint position_buffer,
+	GLuint normals_buffer,
+	GLsizei first,
+	const glm::vec3* positions,
+	const glm::vec3* normals,
+	GLsizei vertex_count
+)
+{
+	GLintptr offset = first * VertexStride(layout);
+	if (layout == VERTEX_LAYOUT_SEPARATE)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, position_buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, vertex_count * sizeof(glm::vec3), positions);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, normals_buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, vertex_count * sizeof(glm::vec3), normals);
+	}
+	else if (layout == VERTEX_LAYOUT_COMPACT)
+	{
+		auto vertices = InterleaveCompact(positions, normals, vertex_count);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, position_buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, vertices.size() * sizeof(CompactVertex), vertices.data());
+	}
+	else
+	{
+		auto vertices = InterleaveCompactHalf(positions, normals, vertex_count);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, position_buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, vertices.size() * sizeof(CompactHalfVertex), vertices.data());
+	}
+}
+
+// Points the position and normal attributes of the bound vertex array at the buffers.
+static void SetVertexAttributes(VertexLayout layout, GLuint position_buffer, GLuint normals_buffer)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, position_buffer);
+	if (layout == VERTEX_LAYOUT_SEPARATE)
+	{
+		glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, 0, static_cast<void *>(0));
+		glBindBuffer(GL_ARRAY_BUFFER, normals_buffer);
+		glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, 0, static_cast<void *>(0));
+	}
+	else if (layout == VERTEX_LAYOUT_COMPACT)
+	{
+		glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, sizeof(CompactVertex), reinterpret_cast<void *>(offsetof(CompactVertex, position)));
+		glVertexAttribPointer(normal_location, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(CompactVertex), reinterpret_cast<void *>(offsetof(CompactVertex, normal)));
+	}
+	else
+	{
+		glVertexAttribPointer(position_location, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactHalfVertex), reinterpret_cast<void *>(offsetof(CompactHalfVertex, position)));
+		glVertexAttribPointer(normal_location, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(CompactHalfVertex), reinterpret_cast<void *>(offsetof(CompactHalfVertex, normal)));
+	}
+	glEnableVertexAttribArray(position_location);
+	glEnableVertexAttribArray(normal_location);
+}
+
+// Triangles then their edges and strips, one element buffer, in 16-bit indices whenever the vertex count allows.
+// The edges are generated unless given.
+static std::vector<unsigned char> PackElements(
+	const GLuint* indices,
+	GLsizei index_count,
+	GLsizei vertex_count,
+	const std::vector<GLuint>* edges,
+	GLenum& index_type,
+	GLsizei& edge_count,
+	GLsizei& strip_count
+)
+{
+	std::vector<GLuint> generated;
+	if (!edges)
+	{
+		generated = GenerateEdgeIndices(indices, index_count);
+		edges = &generated;
+	}
+	edge_count = GLsizei(edges->size());
+
+	std::vector<GLuint> elements(indices, indices + index_count);
+	std::vector<GLuint> strips = GenerateTriangleStrips(elements, vertex_count);
+	strip_count = GLsizei(strips.size());
+	elements.insert(elements.end(), edges->begin(), edges->end());
+	elements.insert(elements.end(), strips.begin(), strips.end());
+
+	// indices of meshes below 65535 vertices fit in 16 bits, 0xFFFF stays free as the strip restart index
+	// and the narrowing turns primitive_restart_index into it
+	std::vector<unsigned char> bytes;
+	if (vertex_count <= 0xFFFF)
+	{
+		index_type = GL_UNSIGNED_SHORT;
+		std::vector<GLushort> short_indices(elements.begin(), elements.end());
+		bytes.resize(short_indices.size() * sizeof(GLushort));
+		std::memcpy(bytes.data(), short_indices.data(), bytes.size());
+	}
+	else
+	{
+		index_type = GL_UNSIGNED_INT;
+		bytes.resize(elements.size() * sizeof(GLuint));
+		std::memcpy(bytes.data(), elements.data(), bytes.size());
+	}
+	return bytes;
+}
+
+PackedMesh PackMesh(
+	VertexLayout layout,
+	const glm::vec3* positions,
+	const glm::vec3* normals,
+	GLsizei vertex_count,
+	const GLuint* indices,
+	GLsizei index_count,
+	std::vector<unsigned char>& vertices,
+	std::vector<unsigned char>& elements,
+	const std::vector<GLuint>* edges
+)
+{
+	PackedMesh mesh;
+	mesh.layout = layout;
+	mesh.vertex_count = vertex_count;
+	mesh.index_count = index_count;
+	mesh.bounds = ComputeBoundingVolume(positions, vertex_count);
+
+	vertices = PackVertices(layout, positions, normals, vertex_count);
+	elements = PackElements(indices, index_count, vertex_count, edges, mesh.index_type, mesh.edge_count, mesh.strip_count);
+	mesh.vertices = vertices.data();
+	mesh.vertices_size = GLsizeiptr(vertices.size());
+	mesh.elements = elements.data();
+	mesh.elements_size = GLsizeiptr(elements.size());
+	return mesh;
+}
+
+/* OpenGL Utility Structs */
+
+VAO::VAO()
+	: id(0), layout(VERTEX_LAYOUT_SEPARATE), vertex_count(0), position_buffer(0), normals_buffer(0),
+	  element_array_count(0), element_array_buffer(0), index_type(GL_UNSIGNED_INT), edge_count(0), strip_count(0),
+	  vertex_storage(0), element_storage(0),
+	  arena(nullptr), base_vertex(0), first_index(0),
+	  profile_table(nullptr), profile_first(0), profile_samples(0), rotation_segments(0), bounds(), resident(true),
+	  instance_count(0), instance_array(0), instance_buffers(nullptr), instance_arena_buffers{ 0, 0 }
+{
+}
+
 VAO::VAO(
 	const std::vector<glm::vec3>& positions,
 	const std::vector<glm::vec3>& normals,
-	const std::vector<GLuint>& indices
+	const std::vector<GLuint>& indices,
+	VertexLayout layout
 )
+	: VAO(positions.data(), normals.data(), GLsizei(positions.size()), indices.data(), GLsizei(indices.size()), layout)
+{
+}
+
+VAO::VAO(
+	const glm::vec3* positions,
+	const glm::vec3* normals,
+	GLsizei vertex_count,
+	const GLuint* indices,
+	GLsizei index_count,
+	VertexLayout layout
+)
+	: VAO()
 {
 	glGenVertexArrays(1, &id);
 	glBindVertexArray(id);
+	instance_array = id;
 
-	vertex_count = GLsizei(positions.size());
+	this->layout = layout;
+	this->vertex_count = vertex_count;
+	bounds = ComputeBoundingVolume(positions, vertex_count);
 
+	vertex_storage = vertex_count * VertexStride(layout);
 	glGenBuffers(1, &position_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, position_buffer);
-	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, position_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertex_storage, nullptr, GL_STATIC_DRAW);
+	normals_buffer = position_buffer;
+	if (layout == VERTEX_LAYOUT_SEPARATE)
+	{
+		glGenBuffers(1, &normals_buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, normals_buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, vertex_storage, nullptr, GL_STATIC_DRAW);
+	}
+	WriteVertices(layout, position_buffer, normals_buffer, 0, positions, normals, vertex_count);
+	SetVertexAttributes(layout, position_buffer, normals_buffer);
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, static_cast<void *>(0));
-	glEnableVertexAttribArray(0);
 
+	element_array_count = index_count;
+	std::vector<unsigned char> elements = PackElements(indices, index_count, vertex_count, nullptr, index_type, edge_count, strip_count);
+	element_storage = GLsizeiptr(elements.size());
 
-	glGenBuffers(1, &normals_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, normals_buffer);
-	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_STATIC_DRAW);
+	glGenBuffers(1, &element_array_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_array_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, element_storage, elements.data(), GL_STATIC_DRAW);
+}
 
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, static_cast<void *>(0));
-	glEnableVertexAttribArray(1);
+VAO::VAO(const PackedMesh& mesh)
+	: VAO()
+{
+	glGenVertexArrays(1, &id);
+	glBindVertexArray(id);
+	instance_array = id;
 
+	layout = mesh.layout;
+	vertex_count = mesh.vertex_count;
+	element_array_count = mesh.index_count;
+	edge_count = mesh.edge_count;
+	strip_count = mesh.strip_count;
+	index_type = mesh.index_type;
+	bounds = mesh.bounds;
 
-	element_array_count = GLsizei(indices.size());
+	vertex_storage = vertex_count * VertexStride(layout);
+	glGenBuffers(1, &position_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, position_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertex_storage, mesh.vertices, GL_STATIC_DRAW);
+	normals_buffer = position_buffer;
+	if (layout == VERTEX_LAYOUT_SEPARATE)
+	{
+		glGenBuffers(1, &normals_buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, normals_buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, vertex_storage, mesh.vertices + vertex_storage, GL_STATIC_DRAW);
+	}
+	SetVertexAttributes(layout, position_buffer, normals_buffer);
 
+	element_storage = mesh.elements_size;
 	glGenBuffers(1, &element_array_buffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_array_buffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, element_storage, mesh.elements, GL_STATIC_DRAW);
+}
+
+void VAO::Refill(
+	const glm::vec3* positions,
+	const glm::vec3* normals,
+	GLsizei vertex_count,
+	const GLuint* indices,
+	GLsizei index_count,
+	const std::vector<GLuint>* edges
+)
+{
+	this->vertex_count = vertex_count;
+	bounds = ComputeBoundingVolume(positions, vertex_count);
+
+	// the buffer names stay, so the vertex array's attachments stay valid without binding it
+	GLsizeiptr vertex_size = vertex_count * VertexStride(layout);
+	vertex_storage = std::max(vertex_storage, vertex_size);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, position_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertex_storage, nullptr, GL_DYNAMIC_DRAW);
+	if (layout == VERTEX_LAYOUT_SEPARATE)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, normals_buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, vertex_storage, nullptr, GL_DYNAMIC_DRAW);
+	}
+	WriteVertices(layout, position_buffer, normals_buffer, 0, positions, normals, vertex_count);
+
+	element_array_count = index_count;
+	std::vector<unsigned char> elements = PackElements(indices, index_count, vertex_count, edges, index_type, edge_count, strip_count);
+	element_storage = std::max(element_storage, GLsizeiptr(elements.size()));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, element_array_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, element_storage, nullptr, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, elements.size(), elements.data());
+}
+
+void VAO::SetInstances(const InstanceBuffers& instances)
+{
+	instance_count = instances.count;
+
+	// growing an arena replaces its buffers, which an arena mesh's own vertex array must follow
+	bool arena_moved = arena && (instance_arena_buffers[0] != arena->position_buffer || instance_arena_buffers[1] != arena->element_array_buffer);
+	if (instance_buffers == &instances && !arena_moved)
+		return;
+	instance_buffers = &instances;
+
+	// instance attributes would reach every mesh sharing the arena's vertex array, so an arena mesh gets
+	// a vertex array of its own over the arena buffers
+	if (arena)
+	{
+		if (instance_array == 0)
+			glGenVertexArrays(1, &instance_array);
+		glBindVertexArray(instance_array);
+		SetVertexAttributes(arena->layout, arena->position_buffer, arena->normals_buffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena->element_array_buffer);
+		instance_arena_buffers[0] = arena->position_buffer;
+		instance_arena_buffers[1] = arena->element_array_buffer;
+	}
+	else
+		glBindVertexArray(id);
+
+	glBindBuffer(GL_ARRAY_BUFFER, instances.offset_buffer);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, static_cast<void *>(0));
+	glVertexAttribDivisor(2, 1);
+	glEnableVertexAttribArray(2);
+
+	glBindBuffer(GL_ARRAY_BUFFER, instances.color_buffer);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, static_cast<void *>(0));
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(3);
+}
+
+InstanceBuffers::InstanceBuffers()
+	: offset_buffer(0), color_buffer(0), count(0), storage(0)
+{
+	glGenBuffers(1, &offset_buffer);
+	glGenBuffers(1, &color_buffer);
+}
+
+void InstanceBuffers::Upload(const std::vector<glm::vec3>& offsets, const std::vector<glm::vec3>& colors)
+{
+	count = GLsizei(offsets.size());
+	GLsizeiptr size = count * sizeof(glm::vec3);
+
+	// orphaned as in VAO::Refill, the instances of the frame the GPU is still drawing are never waited for
+	storage = std::max(storage, size);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, offset_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, storage, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, offsets.data());
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, color_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, storage, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, colors.data());
+}
+
+GLsizei VAO::ElementCount(GLenum mode) const
+{
+	if (mode == GL_LINES)
+		return edge_count;
+	return mode == GL_TRIANGLE_STRIP ? strip_count : element_array_count;
+}
+
+GLsizei VAO::FirstElement(GLenum mode) const
+{
+	if (mode == GL_LINES)
+		return first_index + element_array_count;
+	return mode == GL_TRIANGLE_STRIP ? first_index + element_array_count + edge_count : first_index;
+}
+
+GLuint VAO::RestartIndex() const
+{
+	return index_type == GL_UNSIGNED_SHORT ? 0xFFFF : primitive_restart_index;
+}
+
+const void* VAO::FirstIndex(GLenum mode) const
+{
+	GLsizeiptr index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	return reinterpret_cast<const void*>(FirstElement(mode) * index_size);
+}
+
+/* Geometry Arena */
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+typedef void (APIENTRYP MultiDrawElementsIndirect)(GLenum mode, GLenum type, const void* indirect, GLsizei draw_count, GLsizei stride);
+
+static MultiDrawElementsIndirect multi_draw_elements_indirect = nullptr;
+
+// Layout fixed by GL_ARB_draw_indirect, base_instance needs GL_ARB_base_instance to be other than 0.
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance;
 };
 
+GLsizei FreeList::Allocate(GLsizei count)
+{
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		Range& range = ranges[i];
+		if (range.count < count)
+			continue;
+
+		GLsizei first = range.first;
+		range.first += count;
+		range.count -= count;
+		if (range.count == 0)
+			ranges.erase(ranges.begin() + i);
+		return first;
+	}
+	return -1;
+}
+
+void FreeList::Free(GLsizei first, GLsizei count)
+{
+	if (count <= 0)
+		return;
+
+	auto next = std::lower_bound(ranges.begin(), ranges.end(), first, [](const Range& range, GLsizei first) { return range.first < first; });
+	next = ranges.insert(next, Range{ first, count });
+
+	if (next + 1 != ranges.end() && next->first + next->count == (next + 1)->first)
+	{
+		next->count += (next + 1)->count;
+		ranges.erase(next + 1);
+	}
+	if (next != ranges.begin() && (next - 1)->first + (next - 1)->count == next->first)
+	{
+		(next - 1)->count += next->count;
+		ranges.erase(next);
+	}
+}
+
+void FreeList::Grow(GLsizei new_capacity)
+{
+	GLsizei old_capacity = capacity;
+	capacity = new_capacity;
+	Free(old_capacity, new_capacity - old_capacity);
+}
+
+// Replaces buffer with a larger one holding the same first used_size bytes.
+static void GrowBuffer(GLuint& buffer, GLsizeiptr used_size, GLsizeiptr new_size)
+{
+	GLuint grown;
+	glGenBuffers(1, &grown);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, new_size, nullptr, GL_STATIC_DRAW);
+
+	if (buffer != 0)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used_size);
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer = grown;
+}
+
+GeometryArena::GeometryArena(VertexLayout layout, GLsizei vertex_capacity, GLsizei index_capacity)
+	: id(0), layout(layout), position_buffer(0), normals_buffer(0), element_array_buffer(0), draw_buffer(0), indirect_buffer(0)
+{
+	glGenVertexArrays(1, &id);
+
+	if (multi_draw_elements_indirect)
+	{
+		glBindVertexArray(id);
+		glGenBuffers(1, &draw_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, draw_buffer);
+		glVertexAttribPointer(draw_attribute_location, 2, GL_FLOAT, GL_FALSE, 0, static_cast<void *>(0));
+		glVertexAttribDivisor(draw_attribute_location, 1);
+		glEnableVertexAttribArray(draw_attribute_location);
+
+		glGenBuffers(1, &indirect_buffer);
+	}
+
+	Grow(vertex_capacity, index_capacity);
+}
+
+void GeometryArena::Grow(GLsizei vertex_capacity, GLsizei index_capacity)
+{
+	GLsizeiptr stride = VertexStride(layout);
+	if (vertex_capacity > vertices.capacity)
+	{
+		// the compact layouts interleave normals with positions, only the separate one has a normals buffer of its own
+		GrowBuffer(position_buffer, vertices.capacity * stride, vertex_capacity * stride);
+		if (layout == VERTEX_LAYOUT_SEPARATE)
+			GrowBuffer(normals_buffer, vertices.capacity * stride, vertex_capacity * stride);
+		else
+			normals_buffer = position_buffer;
+		vertices.Grow(vertex_capacity);
+	}
+	if (index_capacity > indices.capacity)
+	{
+		GrowBuffer(element_array_buffer, indices.capacity * sizeof(GLushort), index_capacity * sizeof(GLushort));
+		indices.Grow(index_capacity);
+	}
+
+	glBindVertexArray(id);
+	SetVertexAttributes(layout, position_buffer, normals_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_array_buffer);
+}
+
+bool GeometryArena::Reserve(GLsizei vertex_count, GLsizei element_count, GLsizei& first_vertex, GLsizei& first_index)
+{
+	// indices stay local to the mesh, the base vertex moves them, so only the mesh itself must fit 16 bits
+	if (vertex_count > 0xFFFF)
+		return false;
+
+	first_vertex = vertices.Allocate(vertex_count);
+	first_index = indices.Allocate(element_count);
+	if (first_vertex < 0 || first_index < 0)
+	{
+		// the buffer that ran out at least doubles, its new tail merges with any free range before it
+		GLsizei vertex_capacity = vertices.capacity;
+		GLsizei index_capacity = indices.capacity;
+		if (first_vertex < 0)
+			vertex_capacity = std::max(vertex_capacity * 2, vertex_capacity + vertex_count);
+		if (first_index < 0)
+			index_capacity = std::max(index_capacity * 2, index_capacity + element_count);
+		Grow(vertex_capacity, index_capacity);
+
+		if (first_vertex < 0)
+			first_vertex = vertices.Allocate(vertex_count);
+		if (first_index < 0)
+			first_index = indices.Allocate(element_count);
+	}
+	return true;
+}
+
+std::unique_ptr<VAO> GeometryArena::Allocate(const PackedMesh& mesh)
+{
+	// indices stay local to the mesh, the base vertex moves them, so only the mesh itself must fit 16 bits
+	if (mesh.index_type != GL_UNSIGNED_SHORT || mesh.layout != layout)
+		return nullptr;
+
+	// the edge list and the strips are allocated with the triangles, right after them
+	GLsizei element_count = mesh.index_count + mesh.edge_count + mesh.strip_count;
+	GLsizei first_vertex, first_index;
+	if (!Reserve(mesh.vertex_count, element_count, first_vertex, first_index))
+		return nullptr;
+
+	GLsizeiptr vertex_size = mesh.vertex_count * VertexStride(layout);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, position_buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, first_vertex * VertexStride(layout), vertex_size, mesh.vertices);
+	if (layout == VERTEX_LAYOUT_SEPARATE)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, normals_buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, first_vertex * VertexStride(layout), vertex_size, mesh.vertices + vertex_size);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, element_array_buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, first_index * sizeof(GLushort), mesh.elements_size, mesh.elements);
+
+	std::unique_ptr<VAO> vao(new VAO());
+	vao->id = id;
+	vao->layout = layout;
+	vao->vertex_count = mesh.vertex_count;
+	vao->element_array_count = mesh.index_count;
+	vao->edge_count = mesh.edge_count;
+	vao->strip_count = mesh.strip_count;
+	vao->index_type = GL_UNSIGNED_SHORT;
+	vao->arena = this;
+	vao->base_vertex = first_vertex;
+	vao->first_index = first_index;
+	vao->bounds = mesh.bounds;
+	return vao;
+}
+
+void GeometryArena::Free(VAO& vao)
+{
+	vertices.Free(vao.base_vertex, vao.vertex_count);
+	indices.Free(vao.first_index, vao.element_array_count + vao.edge_count + vao.strip_count);
+
+	if (vao.instance_array != 0)
+		glDeleteVertexArrays(1, &vao.instance_array);
+	vao = VAO();
+}
+
+int GeometryArena::Draw(GLenum mode, const ArenaDraw* draws, int count)
+{
+	if (count == 0)
+		return 0;
+
+	if (multi_draw_elements_indirect)
+	{
+		// each draw is one instance whose base instance picks its own per-draw attribute
+		std::vector<DrawElementsIndirectCommand> commands(count);
+		draw_attributes.resize(count);
+		for (int i = 0; i < count; ++i)
+		{
+			const VAO& vao = *draws[i].vao;
+			commands[i] = DrawElementsIndirectCommand{ GLuint(vao.ElementCount(mode)), 1, GLuint(vao.FirstElement(mode)), vao.base_vertex, GLuint(i) };
+			draw_attributes[i] = glm::vec2(float(draws[i].object), draws[i].lod_fade);
+		}
+
+		// both buffers are replaced whole, so the driver never waits on the previous frame's draws
+		glBindBuffer(GL_ARRAY_BUFFER, draw_buffer);
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::vec2), draw_attributes.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, count * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+
+		multi_draw_elements_indirect(mode, GL_UNSIGNED_SHORT, nullptr, count, 0);
+		return 1;
+	}
+
+	// without base instances the per-draw attribute is a current value, set once per run of equal ones
+	int issued = 0;
+	for (int first = 0; first < count; )
+	{
+		int end = first + 1;
+		while (end < count && draws[end].object == draws[first].object && draws[end].lod_fade == draws[first].lod_fade)
+			++end;
+
+		counts.clear();
+		offsets.clear();
+		base_vertices.clear();
+		for (int i = first; i < end; ++i)
+		{
+			counts.push_back(draws[i].vao->ElementCount(mode));
+			offsets.push_back(draws[i].vao->FirstIndex(mode));
+			base_vertices.push_back(draws[i].vao->base_vertex);
+		}
+
+		glVertexAttrib2f(draw_attribute_location, float(draws[first].object), draws[first].lod_fade);
+		glMultiDrawElementsBaseVertex(mode, counts.data(), GL_UNSIGNED_SHORT, offsets.data(), GLsizei(counts.size()), base_vertices.data());
+		++issued;
+		first = end;
+	}
+	return issued;
+}
+
+/* Profile Tables */
+
+ProfileTable::ProfileTable()
+	: id(0), buffer(0), texture(0)
+{
+	glGenVertexArrays(1, &id);
+	glGenBuffers(1, &buffer);
+	glGenTextures(1, &texture);
+}
+
+VAO& ProfileTable::Add(const glm::vec2* positions, const glm::vec2* normals, GLsizei sample_count, GLsizei rotation_segments)
+{
+	std::unique_ptr<VAO> mesh(new VAO());
+	mesh->profile_first = GLint(texels.size());
+	mesh->profile_samples = sample_count;
+
+	// swept around Y the profile fills a cylinder as wide as its furthest point from the axis
+	float radius = 0;
+	glm::vec2 min(0), max(0);
+	for (GLsizei i = 0; i < sample_count; ++i)
+	{
+		texels.push_back(glm::vec4(positions[i].x, positions[i].y, normals[i].x, normals[i].y));
+		radius = std::max(radius, std::abs(positions[i].x));
+		min.y = i == 0 ? positions[i].y : std::min(min.y, positions[i].y);
+		max.y = i == 0 ? positions[i].y : std::max(max.y, positions[i].y);
+	}
+	mesh->bounds.min = glm::vec3(-radius, min.y, -radius);
+	mesh->bounds.max = glm::vec3(radius, max.y, radius);
+	mesh->bounds.center = (mesh->bounds.min + mesh->bounds.max) * 0.5f;
+	mesh->bounds.radius = glm::length(mesh->bounds.max - mesh->bounds.center);
+
+	return Add(*mesh, rotation_segments);
+}
+
+VAO& ProfileTable::Add(const VAO& mesh, GLsizei rotation_segments)
+{
+	std::unique_ptr<VAO> rotated(new VAO());
+	rotated->id = id;
+	rotated->profile_table = this;
+	rotated->profile_first = mesh.profile_first;
+	rotated->profile_samples = mesh.profile_samples;
+	rotated->rotation_segments = rotation_segments;
+	rotated->bounds = mesh.bounds;
+
+	// two triangles per quad as FillGridIndices; three edges per quad, along the profile, around the axis and
+	// across the diagonal, then the ring at the last sample
+	rotated->vertex_count = mesh.profile_samples * rotation_segments;
+	rotated->element_array_count = (mesh.profile_samples - 1) * rotation_segments * 6;
+	rotated->edge_count = rotated->element_array_count + rotation_segments * 2;
+
+	meshes.push_back(std::move(rotated));
+	return *meshes.back();
+}
+
+void ProfileTable::Upload()
+{
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(glm::vec4), texels.data(), GL_STATIC_DRAW);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+}
+
+/* Programs */
+
+Program::Program()
+	: id(0), uploads(0), uploads_avoided(0), from_binary_cache(false), state(PROGRAM_READY), vertex_shader(0), fragment_shader(0)
+{
+}
+
+Program::Program(const GLchar * vertex_shader_source, const GLchar * fragment_shader_source)
+	: id(glCreateProgram()), uploads(0), uploads_avoided(0), from_binary_cache(false), state(PROGRAM_PENDING),
+	  vertex_shader(0), fragment_shader(0), vertex_source(vertex_shader_source), fragment_source(fragment_shader_source),
+	  binary_path(ProgramBinaryPath(vertex_shader_source, fragment_shader_source))
+{
+	from_binary_cache = LoadProgramBinary(id, binary_path);
+	if (!from_binary_cache)
+		SubmitSources();
+}
+
+Program::~Program()
+{
+	if (vertex_shader != 0)
+		glDeleteShader(vertex_shader);
+	if (fragment_shader != 0)
+		glDeleteShader(fragment_shader);
+	if (id != 0)
+		glDeleteProgram(id);
+}
+
+// Compile and link calls return at once, none of the status queries that would wait are made here.
+void Program::SubmitSources()
+{
+	PROFILE_ZONE("Submit shader sources");
+	const GLchar* vertex = vertex_source.c_str();
+	vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertex_shader, 1, &vertex, NULL);
+	glCompileShader(vertex_shader);
+
+	const GLchar* fragment = fragment_source.c_str();
+	fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragment_shader, 1, &fragment, NULL);
+	glCompileShader(fragment_shader);
+
+	glAttachShader(id, vertex_shader);
+	glAttachShader(id, fragment_shader);
+	if (!binary_path.empty())
+		MarkProgramBinaryRetrievable(id);
+	glLinkProgram(id);
+}
+
+static bool ReportShaderErrors(GLuint shader)
+{
+	int success;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (success)
+		return false;
+
+	std::cout << "Error: Shader Compilation failed" << std::endl;
+
+	char info_log[512];
+	glGetShaderInfoLog(shader, 512, NULL, info_log);
+	std::cout << info_log << std::endl;
+	return true;
+}
+
+bool Program::Resolve()
+{
+	if (state != PROGRAM_PENDING)
+		return state == PROGRAM_READY;
+
+	// the first status query waits for the driver to finish the compile and link
+	PROFILE_ZONE("Resolve program");
+
+	int success;
+	glGetProgramiv(id, GL_LINK_STATUS, &success);
+
+	// a binary from another driver build is rejected, build it from the sources after all
+	if (!success && from_binary_cache)
+	{
+		from_binary_cache = false;
+		SubmitSources();
+		glGetProgramiv(id, GL_LINK_STATUS, &success);
+	}
+
+	if (!success)
+	{
+		bool compile_failed = ReportShaderErrors(vertex_shader);
+		compile_failed = ReportShaderErrors(fragment_shader) || compile_failed;
+		if (!compile_failed)
+		{
+			std::cout << "Error: Program Linking failed" << std::endl;
+
+			char info_log[512];
+			glGetProgramInfoLog(id, 512, NULL, info_log);
+			std::cout << info_log << std::endl;
+		}
+	}
+	else if (!from_binary_cache)
+		SaveProgramBinary(id, binary_path);
+
+	if (vertex_shader != 0)
+	{
+		glDeleteShader(vertex_shader);
+		glDeleteShader(fragment_shader);
+		vertex_shader = fragment_shader = 0;
+	}
+	vertex_source.clear();
+	fragment_source.clear();
+
+	if (!success)
+	{
+		glDeleteProgram(id);
+		id = 0;
+		state = PROGRAM_FAILED;
+		return false;
+	}
+
+	state = PROGRAM_READY;
+	Reflect();
+	for (const auto& binding : block_bindings)
+		BindUniformBlock(binding.first, binding.second);
+	return true;
+}
+
+bool Program::Poll()
+{
+	if (state == PROGRAM_PENDING && !IsShaderWorkComplete(id, true))
+		return false;
+	return Resolve();
+}
+
+bool Program::Use()
+{
+	bool ready = Resolve();
+	glUseProgram(id);
+	return ready;
+}
+
+void Program::Reflect()
+{
+	GLint uniform_count = 0;
+	glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &uniform_count);
+	for (GLint i = 0; i < uniform_count; ++i)
+	{
+		char name[256];
+		GLsizei length = 0;
+		Uniform uniform;
+		glGetActiveUniform(id, GLuint(i), sizeof(name), &length, &uniform.size, &uniform.type, name);
+
+		uniform.name.assign(name, length);
+		if (uniform.name.size() > 3 && uniform.name.compare(uniform.name.size() - 3, 3, "[0]") == 0)
+			uniform.name.resize(uniform.name.size() - 3);
+
+		// members of uniform blocks have no location and are not set one by one
+		uniform.location = glGetUniformLocation(id, name);
+		if (uniform.location < 0)
+			continue;
+
+		uniform.uploaded = false;
+		uniforms.push_back(uniform);
+	}
+
+	GLint attribute_count = 0;
+	glGetProgramiv(id, GL_ACTIVE_ATTRIBUTES, &attribute_count);
+	for (GLint i = 0; i < attribute_count; ++i)
+	{
+		char name[256];
+		GLsizei length = 0;
+		GLint size;
+		GLenum type;
+		glGetActiveAttrib(id, GLuint(i), sizeof(name), &length, &size, &type, name);
+		attributes[std::string(name, length)] = glGetAttribLocation(id, name);
+	}
+
+	GLint block_count = 0;
+	glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &block_count);
+	for (GLint i = 0; i < block_count; ++i)
+	{
+		char name[256];
+		GLsizei length = 0;
+		glGetActiveUniformBlockName(id, GLuint(i), sizeof(name), &length, name);
+		uniform_blocks[std::string(name, length)] = GLuint(i);
+	}
+}
+
+UniformHandle Program::Find(const std::string& name)
+{
+	UniformHandle handle;
+	Resolve();
+	for (size_t i = 0; i < uniforms.size(); ++i)
+		if (uniforms[i].name == name)
+			handle.index = int(i);
+	return handle;
+}
+
+GLint Program::AttributeLocation(const std::string& name)
+{
+	Resolve();
+	auto found = attributes.find(name);
+	return found == attributes.end() ? -1 : found->second;
+}
+
+void Program::BindUniformBlock(const std::string& name, GLuint binding)
+{
+	// remembered until the link is checked
+	block_bindings[name] = binding;
+	if (state != PROGRAM_READY)
+		return;
+
+
+	auto found = uniform_blocks.find(name);
+	if (found != uniform_blocks.end())
+		glUniformBlockBinding(id, found->second, binding);
+}
+
+// Booleans and samplers are set with glUniform1i.
+static bool IsIntegerLike(GLenum type)
+{
+	switch (type)
+	{
+	case GL_BOOL:
+	case GL_SAMPLER_1D:
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_2D_ARRAY:
+	case GL_SAMPLER_BUFFER:
+	case GL_INT_SAMPLER_BUFFER:
+	case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Returns the uniform when value differs from its shadow and must be uploaded, nullptr otherwise.
+Program::Uniform* Program::Shadow(UniformHandle handle, GLenum type, const void* value, size_t size)
+{
+	if (handle.index < 0 || handle.index >= int(uniforms.size()))
+		return nullptr;
+
+	Uniform& uniform = uniforms[handle.index];
+	if (uniform.type != type && !(type == GL_INT && IsIntegerLike(uniform.type)))
+	{
+		std::cout << "Error: Uniform " << uniform.name << " set with the wrong type" << std::endl;
+		return nullptr;
+	}
+
+	if (uniform.uploaded && std::memcmp(uniform.value, value, size) == 0)
+	{
+		++uploads_avoided;
+		return nullptr;
+	}
+
+	std::memcpy(uniform.value, value, size);
+	uniform.uploaded = true;
+	++uploads;
+	return &uniform;
+}
+
+void Program::Set(UniformHandle handle, int value)
+{
+	if (Uniform* uniform = Shadow(handle, GL_INT, &value, sizeof(value)))
+		glUniform1i(uniform->location, value);
+}
+
+void Program::Set(UniformHandle handle, float value)
+{
+	if (Uniform* uniform = Shadow(handle, GL_FLOAT, &value, sizeof(value)))
+		glUniform1f(uniform->location, value);
+}
+
+void Program::Set(UniformHandle handle, const glm::vec2& value)
+{
+	if (Uniform* uniform = Shadow(handle, GL_FLOAT_VEC2, &value, sizeof(value)))
+		glUniform2fv(uniform->location, 1, &value.x);
+}
+
+void Program::Set(UniformHandle handle, const glm::vec3& value)
+{
+	if (Uniform* uniform = Shadow(handle, GL_FLOAT_VEC3, &value, sizeof(value)))
+		glUniform3fv(uniform->location, 1, &value.x);
+}
+
+void Program::Set(UniformHandle handle, const glm::vec4& value)
+{
+	if (Uniform* uniform = Shadow(handle, GL_FLOAT_VEC4, &value, sizeof(value)))
+		glUniform4fv(uniform->location, 1, &value.x);
+}
+
+void Program::Set(UniformHandle handle, const glm::ivec4& value)
+{
+	if (Uniform* uniform = Shadow(handle, GL_INT_VEC4, &value, sizeof(value)))
+		glUniform4iv(uniform->location, 1, &value.x);
+}
+
+void Program::Set(UniformHandle handle, const glm::mat4& value)
+{
+	if (Uniform* uniform = Shadow(handle, GL_FLOAT_MAT4, &value, sizeof(value)))
+		glUniformMatrix4fv(uniform->location, 1, GL_FALSE, &value[0][0]);
+}
+
+void Program::ResetCounters()
+{
+	uploads = 0;
+	uploads_avoided = 0;
+}
+
+/* Uniform Buffers */
+
+UniformBuffer::UniformBuffer()
+{
+	glGenBuffers(1, &id);
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+	if (offset_alignment < 1)
+		offset_alignment = 256;
+}
+
+GLintptr UniformBuffer::AddBlock(GLuint binding, GLsizeiptr size)
+{
+	GLintptr offset = (GLintptr(data.size()) + offset_alignment - 1) / offset_alignment * offset_alignment;
+	data.resize(offset + size, 0);
+	ranges.push_back(Range{ binding, offset, size });
+	return offset;
+}
+
+void UniformBuffer::Upload()
+{
+	// replacing the whole store lets the driver hand out fresh memory instead of waiting on last frame's draws
+	glBindBuffer(GL_UNIFORM_BUFFER, id);
+	glBufferData(GL_UNIFORM_BUFFER, data.size(), data.data(), GL_STREAM_DRAW);
+
+	for (const Range& range : ranges)
+		glBindBufferRange(GL_UNIFORM_BUFFER, range.binding, id, range.offset, range.size);
+}
+
 /* OpenGL Utility Functions */
+
+bool HasExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i)
+	{
+		const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+		if (extension && std::strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+bool EnableMultiDrawIndirect(GLADloadproc load)
+{
+	if (HasExtension("GL_ARB_multi_draw_indirect") && HasExtension("GL_ARB_base_instance"))
+		multi_draw_elements_indirect = reinterpret_cast<MultiDrawElementsIndirect>(load("glMultiDrawElementsIndirect"));
+	return multi_draw_elements_indirect != nullptr;
+}
+
 GLuint CreateShaderFromSource(const GLenum& shader_type, const GLchar * source)
 {
 	GLuint shader = glCreateShader(shader_type);
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <iostream>
+#include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "glad/glad.h"
@@ -8,26 +11,414 @@
 
 /* OpenGL Utility Structs */
 
+// How a VAO stores its vertices. Attribute locations are the same in every layout.
+enum VertexLayout
+{
+	VERTEX_LAYOUT_SEPARATE,     // float positions and float normals in two buffers, 24 bytes per vertex
+	VERTEX_LAYOUT_COMPACT,      // one interleaved buffer, float positions and 10:10:10:2 normals, 16 bytes
+	VERTEX_LAYOUT_COMPACT_HALF  // as compact with half-float positions, 12 bytes
+};
+
+// Object-space bounds of a mesh: the box around its vertices and a sphere around the box centre.
+struct BoundingVolume
+{
+	glm::vec3 min;
+	glm::vec3 max;
+	glm::vec3 center;
+	float radius;
+};
+
+BoundingVolume ComputeBoundingVolume(const glm::vec3* positions, GLsizei vertex_count);
+
+// Bytes per vertex in each vertex buffer of the layout.
+GLsizeiptr VertexStride(VertexLayout layout);
+
+// A mesh as its buffers hold it, uploaded as plain bytes with no conversion, e.g. straight from a mapped cache
+// file. The vertices are packed for layout, the separate layout's two buffers one after the other, positions
+// first. The elements are the triangles followed by their edges and their strips, in 16-bit indices whenever
+// vertex_count allows.
+struct PackedMesh
+{
+	VertexLayout layout;
+	GLsizei vertex_count;
+	GLsizei index_count; // of the triangles, edge_count edge indices and strip_count strip indices follow them
+	GLsizei edge_count;
+	GLsizei strip_count;
+	GLenum index_type;
+	BoundingVolume bounds;
+
+	const unsigned char* vertices;
+	GLsizeiptr vertices_size;
+	const unsigned char* elements;
+	GLsizeiptr elements_size;
+};
+
+// Packs a mesh into vertices and elements, which the result points into. Edges from GenerateEdgeIndices
+// can be passed in, otherwise they are generated.
+PackedMesh PackMesh(
+	VertexLayout layout,
+	const glm::vec3* positions,
+	const glm::vec3* normals,
+	GLsizei vertex_count,
+	const GLuint* indices,
+	GLsizei index_count,
+	std::vector<unsigned char>& vertices,
+	std::vector<unsigned char>& elements,
+	const std::vector<GLuint>* edges = nullptr
+);
+
+struct GeometryArena;
+struct ProfileTable;
+
+// Per-instance offsets (location 2) and colors (location 3) in buffers of their own. Meshes point their
+// instanced vertex arrays at them with VAO::SetInstances, so the levels of a chain draw from one upload.
+struct InstanceBuffers
+{
+	GLuint offset_buffer;
+	GLuint color_buffer;
+	GLsizei count;
+	GLsizeiptr storage; // bytes allocated for each buffer
+
+	InstanceBuffers();
+
+	// Orphans both buffers and writes the instances. The names stay, so vertex arrays pointed at them need no update.
+	void Upload(const std::vector<glm::vec3>& offsets, const std::vector<glm::vec3>& colors);
+};
+
 struct VAO
 {
 	GLuint id;
 
+	VertexLayout layout;
 	GLsizei vertex_count;
 	GLuint position_buffer;
-	GLuint normals_buffer;
+	GLuint normals_buffer; // same as position_buffer in the compact layouts
 
 	GLsizei element_array_count;
 	GLuint element_array_buffer;
+	GLenum index_type; // GL_UNSIGNED_SHORT whenever every index fits, pass it to glDrawElements
+
+	// GL_LINES pairs of every edge once, from GenerateEdgeIndices. They follow the triangles in the same
+	// element buffer, so a wireframe draw differs from a solid one only in its count and offset.
+	GLsizei edge_count;
+
+	// GL_TRIANGLE_STRIP indices from GenerateTriangleStrips after the edges, the same triangles in fewer indices.
+	// Strips are joined by RestartIndex, draw them with primitive restart enabled at that index.
+	GLsizei strip_count;
+
+	// bytes allocated for each vertex buffer and for the element buffer, Refill reuses them while the data fits
+	GLsizeiptr vertex_storage;
+	GLsizeiptr element_storage;
+
+	// Set when the mesh was placed in a GeometryArena: id and the buffers are the arena's, shared with
+	// every other mesh there, and draws pass base_vertex and the byte offset of first_index.
+	GeometryArena* arena;
+	GLint base_vertex;
+	GLsizei first_index;
+
+	// Set when the mesh is pulled from a ProfileTable: id is the table's empty vertex array and there are no
+	// buffers. The counts above are those of the grid the vertex shader rebuilds, drawn with glDrawArrays.
+	ProfileTable* profile_table;
+	GLint profile_first; // first texel of the mesh's profile
+	GLsizei profile_samples;
+	GLsizei rotation_segments;
+
+	BoundingVolume bounds; // computed from the positions at upload
+
+	// false while the mesh is still being streamed in by a MeshStreamer, nothing may draw it then
+	bool resident;
+
+	// per-instance attributes from InstanceBuffers, advanced once per instance
+	GLsizei instance_count;
+	GLuint instance_array; // vertex array for instanced draws, id itself outside an arena
+	const InstanceBuffers* instance_buffers; // what instance_array points at, null before SetInstances
+	GLuint instance_arena_buffers[2]; // the arena's vertex and element buffers when it was pointed there
+
+	// an empty mesh, filled in by GeometryArena::Allocate or ProfileTable::Add
+	VAO();
 
 	VAO(
 		const std::vector<glm::vec3>& positions,
 		const std::vector<glm::vec3>& normals,
-		const std::vector<GLuint>& indices
+		const std::vector<GLuint>& indices,
+		VertexLayout layout = VERTEX_LAYOUT_SEPARATE
+	);
+
+	// uploads straight from caller memory, e.g. a memory-mapped mesh cache file
+	VAO(
+		const glm::vec3* positions,
+		const glm::vec3* normals,
+		GLsizei vertex_count,
+		const GLuint* indices,
+		GLsizei index_count,
+		VertexLayout layout = VERTEX_LAYOUT_SEPARATE
+	);
+
+	// uploads a packed mesh's bytes as they are
+	explicit VAO(const PackedMesh& mesh);
+
+	// Replaces the whole mesh, keeping the vertex array and buffer names so nothing bound to them changes.
+	// Each buffer is orphaned and only the bytes in use are written, so a mesh the GPU may still be reading
+	// never stalls the caller; storage is reallocated only when the new data no longer fits.
+	// Only for meshes built by the constructors above, not for arena or profile table meshes. Edges from
+	// GenerateEdgeIndices can be passed in when they were found elsewhere, e.g. on the thread that built the mesh.
+	void Refill(
+		const glm::vec3* positions,
+		const glm::vec3* normals,
+		GLsizei vertex_count,
+		const GLuint* indices,
+		GLsizei index_count,
+		const std::vector<GLuint>* edges = nullptr
 	);
+
+	// Draws the instances of instances, which must have been uploaded. Vertex array state is only set the first
+	// time, or after an arena mesh's arena has grown; afterwards this only takes the instance count.
+	void SetInstances(const InstanceBuffers& instances);
+
+	// What a draw in mode reads: the edge list for GL_LINES, the strips for GL_TRIANGLE_STRIP, the triangles
+	// for any other mode.
+	GLsizei ElementCount(GLenum mode) const;
+	GLsizei FirstElement(GLenum mode) const;
+
+	// primitive_restart_index as index_type stores it
+	GLuint RestartIndex() const;
+
+	// The indices argument of the glDraw* calls, the byte offset of FirstElement.
+	const void* FirstIndex(GLenum mode) const;
+};
+
+// Per-draw vertex attribute (x: object entry, y: level-of-detail fade). An arena feeds it from a buffer
+// during indirect draws, everywhere else the attribute array is off and the current value is used.
+const GLuint draw_attribute_location = 4;
+
+// One draw of a mesh placed in a GeometryArena.
+struct ArenaDraw
+{
+	const VAO* vao;
+	int object;
+	float lod_fade;
+};
+
+// Ranges of a buffer counted in elements, handed out first fit and merged with their neighbours when freed.
+struct FreeList
+{
+	struct Range
+	{
+		GLsizei first;
+		GLsizei count;
+	};
+
+	std::vector<Range> ranges; // sorted, never adjacent
+	GLsizei capacity = 0;
+
+	// First element of count free ones, -1 when no range is large enough.
+	GLsizei Allocate(GLsizei count);
+	void Free(GLsizei first, GLsizei count);
+
+	// Adds the elements between capacity and new_capacity.
+	void Grow(GLsizei new_capacity);
+};
+
+// Vertices and 16-bit indices of many meshes suballocated from one set of buffers under one vertex array,
+// so meshes drawn together need a single bind and go out as one multi-draw. The buffers grow on demand,
+// which moves every mesh's data but not its base vertex or first index.
+struct GeometryArena
+{
+	GLuint id;
+	VertexLayout layout;
+	GLuint position_buffer;
+	GLuint normals_buffer; // same as position_buffer in the compact layouts
+	GLuint element_array_buffer;
+
+	GLuint draw_buffer; // per-draw attributes of the last indirect draw, 0 without indirect draws
+	GLuint indirect_buffer;
+
+	FreeList vertices;
+	FreeList indices;
+
+	explicit GeometryArena(VertexLayout layout, GLsizei vertex_capacity = 1 << 16, GLsizei index_capacity = 1 << 18);
+
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+	// A mesh drawn from the arena, written from its packed bytes. nullptr when its indices are not 16-bit,
+	// as for meshes with too many vertices, or when it was packed for another layout.
+	std::unique_ptr<VAO> Allocate(const PackedMesh& mesh);
+
+	// Ranges for vertex_count vertices and element_count indices, the buffers grow when they are full.
+	// False when the mesh has too many vertices for 16-bit indices. Allocate reserves and then writes;
+	// a caller writing the ranges itself fills in the VAO as Allocate does.
+	bool Reserve(GLsizei vertex_count, GLsizei element_count, GLsizei& first_vertex, GLsizei& first_index);
+
+	// Returns the mesh's ranges to the free lists, the VAO must not be drawn afterwards.
+	void Free(VAO& vao);
+
+	// Draws meshes of this arena with the arena's vertex array bound. Returns the number of draw calls issued:
+	// one with indirect draws, otherwise one per run of draws sharing their per-draw attribute.
+	int Draw(GLenum mode, const ArenaDraw* draws, int count);
+
+private:
+	void Grow(GLsizei vertex_capacity, GLsizei index_capacity);
+
+	std::vector<GLsizei> counts;
+	std::vector<const void*> offsets;
+	std::vector<GLint> base_vertices;
+	std::vector<glm::vec2> draw_attributes;
+};
+
+// Profiles of surfaces of revolution in one buffer texture, one RGBA32F texel per sample: the profile point in
+// xy and its 2D normal in zw. Meshes added here own no vertex data, SHADER_PULLED vertex shaders rebuild each
+// vertex from gl_VertexID, the mesh's texels and its rotation count. A mesh costs 16 bytes per profile sample
+// whatever its rotation count, and another rotation count of the same profile costs nothing at all.
+struct ProfileTable
+{
+	GLuint id; // vertex array with no attribute arrays enabled, core contexts draw nothing without one bound
+	GLuint buffer;
+	GLuint texture;
+
+	std::vector<glm::vec4> texels; // mirrored on the GPU by Upload
+	std::vector<std::unique_ptr<VAO>> meshes;
+
+	ProfileTable();
+
+	ProfileTable(const ProfileTable&) = delete;
+	ProfileTable& operator=(const ProfileTable&) = delete;
+
+	// The grid GenerateParametricShapeFrom2D would build from these profile samples, with the same vertex and
+	// triangle order. The texels reach the GPU with the next Upload.
+	VAO& Add(const glm::vec2* positions, const glm::vec2* normals, GLsizei sample_count, GLsizei rotation_segments);
+
+	// The profile of mesh, already in the table, rotated another number of times.
+	VAO& Add(const VAO& mesh, GLsizei rotation_segments);
+
+	void Upload();
+};
+
+// Index of a reflected uniform in its Program, -1 when the program has no such active uniform.
+struct UniformHandle
+{
+	int index = -1;
+};
+
+// A linked program with its active uniforms and attributes reflected once at link time.
+// Every uniform keeps a shadow of the value last uploaded, setting the same value again costs no GL call.
+// Construction only submits the compile and link (or loads a cached binary); the link is checked the first
+// time the program is used, so the driver can work on all programs at once.
+struct Program
+{
+	struct Uniform
+	{
+		std::string name; // arrays without the trailing [0]
+		GLint location;
+		GLenum type;
+		GLint size;
+		bool uploaded;
+		unsigned char value[sizeof(glm::mat4)];
+	};
+
+	GLuint id; // 0 once compiling or linking failed, every setter is then a no-op
+	std::vector<Uniform> uniforms;
+	std::map<std::string, GLint> attributes;
+	std::map<std::string, GLuint> uniform_blocks;
+
+	// glUniform calls issued and skipped since the counters were last reset
+	int uploads;
+	int uploads_avoided;
+
+	bool from_binary_cache;
+
+	Program();
+	Program(const GLchar * vertex_shader_source, const GLchar * fragment_shader_source);
+	~Program();
+
+	Program(const Program&) = delete;
+	Program& operator=(const Program&) = delete;
+
+	// Waits for the link on the first call and reflects the program. False when it failed to build.
+	bool Resolve();
+
+	// Resolves the program only once the driver reports the link done, so it never waits.
+	// False while it is still being built, and when it failed.
+	bool Poll();
+
+	// Resolves and makes the program current. A failed program leaves no program bound.
+	bool Use();
+
+	UniformHandle Find(const std::string& name);
+	GLint AttributeLocation(const std::string& name);
+
+	// Points the named uniform block at a buffer binding, blocks the program lacks are skipped.
+	void BindUniformBlock(const std::string& name, GLuint binding);
+
+	// The program must be in use. A handle whose uniform has another type is reported and ignored.
+	void Set(UniformHandle handle, int value);
+	void Set(UniformHandle handle, float value);
+	void Set(UniformHandle handle, const glm::vec2& value);
+	void Set(UniformHandle handle, const glm::vec3& value);
+	void Set(UniformHandle handle, const glm::vec4& value);
+	void Set(UniformHandle handle, const glm::ivec4& value);
+	void Set(UniformHandle handle, const glm::mat4& value);
+
+	void ResetCounters();
+
+private:
+	enum State
+	{
+		PROGRAM_PENDING,
+		PROGRAM_READY,
+		PROGRAM_FAILED
+	};
+
+	void SubmitSources();
+	void Reflect();
+	Uniform* Shadow(UniformHandle handle, GLenum type, const void* value, size_t size);
+
+	State state;
+	GLuint vertex_shader;
+	GLuint fragment_shader;
+	std::string vertex_source; // kept until resolved, a stale cached binary is rebuilt from them
+	std::string fragment_source;
+	std::string binary_path;
+	std::map<std::string, GLuint> block_bindings;
+};
+
+// Several std140 blocks in one buffer, each bound with glBindBufferRange to its own binding point.
+// The blocks are written in CPU memory and the whole buffer is replaced with one glBufferData per Upload.
+struct UniformBuffer
+{
+	GLuint id;
+	std::vector<unsigned char> data;
+
+	UniformBuffer();
+
+	// Reserves size bytes at the next offset the driver accepts for a range, returns that offset.
+	GLintptr AddBlock(GLuint binding, GLsizeiptr size);
+
+	template<typename T>
+	T* Block(GLintptr offset) { return reinterpret_cast<T*>(&data[offset]); }
+
+	void Upload();
+
+private:
+	struct Range
+	{
+		GLuint binding;
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+
+	std::vector<Range> ranges;
+	GLint offset_alignment;
 };
 
 /* OpenGL Utility Functions */
 
+bool HasExtension(const char* name);
+
+// Lets arenas created afterwards submit with glMultiDrawElementsIndirect, which needs GL_ARB_multi_draw_indirect
+// and GL_ARB_base_instance on a 3.3 context. load resolves the entry point. Returns whether both are present.
+bool EnableMultiDrawIndirect(GLADloadproc load);
+
 GLuint CreateShaderFromSource(const GLenum& shader_type, const GLchar * source);
 
 GLuint CreateProgramFromSources(const GLchar * vertex_shader_source, const GLchar * fragment_shader_source);
@@ -0,0 +1,300 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+/* Profiler */
+
+std::atomic<bool> profiler_enabled(false);
+
+namespace
+{
+	struct ZoneEvent
+	{
+		const char* name;
+		uint64_t start; // nanoseconds since the profiler epoch
+		uint64_t end;
+	};
+
+	const size_t zone_capacity = 1 << 16; // per thread, older zones are overwritten
+
+	// A ZoneEvent as stored in a ring, readers copy it while its thread may be overwriting it.
+	struct ZoneSlot
+	{
+		std::atomic<const char*> name;
+		std::atomic<uint64_t> start;
+		std::atomic<uint64_t> end;
+	};
+
+	// Written only by its thread, as a sequence lock: begun counts zones whose slot is being or has been written,
+	// count those complete and published with release. A copy made while begun passed its slot may be torn.
+	struct ThreadBuffer
+	{
+		std::vector<ZoneSlot> events;
+		std::atomic<uint64_t> begun;
+		std::atomic<uint64_t> count;
+		std::string name;
+		int id;
+
+		ThreadBuffer() : events(zone_capacity), begun(0), count(0), id(0) {}
+	};
+
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	// the registry is locked once per thread, when it records its first zone, and by readers
+	std::mutex registry_mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> thread_buffers;
+	std::set<std::string> interned_names;
+
+	thread_local ThreadBuffer* local_buffer = nullptr;
+
+	// GPU passes have their own track, written by whichever thread owns the context
+	ThreadBuffer gpu_buffer;
+
+	uint64_t Now()
+	{
+		return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+	}
+
+	ThreadBuffer& LocalBuffer()
+	{
+		if (!local_buffer)
+		{
+			std::lock_guard<std::mutex> lock(registry_mutex);
+			thread_buffers.emplace_back(new ThreadBuffer());
+			local_buffer = thread_buffers.back().get();
+			local_buffer->id = int(thread_buffers.size());
+			local_buffer->name = "Thread " + std::to_string(local_buffer->id);
+		}
+		return *local_buffer;
+	}
+
+	void Append(ThreadBuffer& buffer, const ZoneEvent& event)
+	{
+		uint64_t count = buffer.count.load(std::memory_order_relaxed);
+		ZoneSlot& slot = buffer.events[count % zone_capacity];
+
+		// a reader that sees any of the new fields also sees begun moved past the slot
+		buffer.begun.store(count + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.name.store(event.name, std::memory_order_relaxed);
+		slot.start.store(event.start, std::memory_order_relaxed);
+		slot.end.store(event.end, std::memory_order_relaxed);
+		buffer.count.store(count + 1, std::memory_order_release);
+	}
+
+	// Calls visit for every zone still held by buffer, oldest first. Safe while its thread keeps recording,
+	// zones overwritten during the copy are left out.
+	template<typename Visit>
+	void ForEachZone(const ThreadBuffer& buffer, const Visit& visit)
+	{
+		uint64_t count = buffer.count.load(std::memory_order_acquire);
+		uint64_t first = count > zone_capacity ? count - zone_capacity : 0;
+
+		std::vector<ZoneEvent> zones;
+		zones.reserve(size_t(count - first));
+		for (uint64_t i = first; i < count; ++i)
+		{
+			const ZoneSlot& slot = buffer.events[i % zone_capacity];
+			zones.push_back(ZoneEvent{ slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed),
+				slot.end.load(std::memory_order_relaxed) });
+		}
+
+		// zone i is rewritten by the zone begun as number i + zone_capacity, the oldest copies go first
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t begun = buffer.begun.load(std::memory_order_relaxed);
+		uint64_t torn = begun > first + zone_capacity ? begun - (first + zone_capacity) : 0;
+		for (size_t i = size_t(std::min<uint64_t>(torn, zones.size())); i < zones.size(); ++i)
+			visit(zones[i]);
+	}
+}
+
+void EnableProfiler(bool enabled)
+{
+	profiler_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+const char* InternZoneName(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	return interned_names.insert(name).first->c_str();
+}
+
+void SetProfilerThreadName(const char* name)
+{
+	if (!IsProfilerEnabled())
+		return;
+	ThreadBuffer& buffer = LocalBuffer();
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	buffer.name = name;
+}
+
+ProfileZone::ProfileZone(const char* name)
+	: name(nullptr), start(0)
+{
+	if (!IsProfilerEnabled() || !name)
+		return;
+	this->name = name;
+	start = Now();
+}
+
+ProfileZone::~ProfileZone()
+{
+	if (name)
+		Append(LocalBuffer(), ZoneEvent{ name, start, Now() });
+}
+
+/* GPU Profiler */
+
+GpuProfiler::~GpuProfiler()
+{
+	for (auto& frame_passes : passes)
+		for (Pass& pass : frame_passes)
+			if (pass.query != 0)
+				glDeleteQueries(1, &pass.query);
+}
+
+void GpuProfiler::BeginFrame()
+{
+	frame = (frame + 1) % frames_in_flight;
+	pass_count = 0;
+
+	for (Pass& pass : passes[frame])
+	{
+		if (!pass.pending)
+			continue;
+		pass.pending = false;
+
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(pass.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			++dropped;
+			continue;
+		}
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(pass.query, GL_QUERY_RESULT, &elapsed);
+		Append(gpu_buffer, ZoneEvent{ pass.name, pass.cpu_start, pass.cpu_start + elapsed });
+	}
+}
+
+void GpuProfiler::BeginPass(const char* name)
+{
+	if (!IsProfilerEnabled() || in_pass || pass_count == max_passes)
+		return;
+
+	Pass& pass = passes[frame][pass_count++];
+	if (pass.query == 0)
+		glGenQueries(1, &pass.query);
+	pass.name = name;
+	pass.cpu_start = Now();
+	pass.pending = true;
+
+	glBeginQuery(GL_TIME_ELAPSED, pass.query);
+	in_pass = true;
+}
+
+void GpuProfiler::EndPass()
+{
+	if (!in_pass)
+		return;
+	glEndQuery(GL_TIME_ELAPSED);
+	in_pass = false;
+}
+
+/* Reports */
+
+void PrintProfileSummary(std::ostream& out, double window_seconds)
+{
+	struct Summary
+	{
+		int count = 0;
+		uint64_t total = 0;
+		uint64_t longest = 0;
+	};
+
+	uint64_t now = Now();
+	uint64_t window = uint64_t(window_seconds * 1e9);
+	uint64_t window_start = now > window ? now - window : 0;
+
+	std::map<std::string, Summary> zones;
+	auto add = [&](const std::string& prefix, const ZoneEvent& event) {
+		if (event.end < window_start)
+			return;
+		Summary& summary = zones[prefix + event.name];
+		++summary.count;
+		summary.total += event.end - event.start;
+		summary.longest = std::max(summary.longest, event.end - event.start);
+	};
+
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		for (auto& buffer : thread_buffers)
+			ForEachZone(*buffer, [&](const ZoneEvent& event) { add("", event); });
+	}
+	ForEachZone(gpu_buffer, [&](const ZoneEvent& event) { add("GPU ", event); });
+
+	out << "Profile of the last " << window_seconds << " s:" << std::endl;
+	for (auto& zone : zones)
+	{
+		const Summary& summary = zone.second;
+		out << "  " << zone.first << ": " << summary.count << "x, " << summary.total / 1e6 / summary.count << " ms average, "
+			<< summary.longest / 1e6 << " ms longest" << std::endl;
+	}
+}
+
+std::string JsonString(const std::string& text)
+{
+	std::string quoted = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			quoted += '\\';
+		if (static_cast<unsigned char>(c) >= 0x20)
+			quoted += c;
+	}
+	return quoted + "\"";
+}
+
+bool WriteChromeTrace(const std::string& path)
+{
+	std::ofstream file(path, std::ios::trunc);
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+
+	bool first = true;
+	auto write_track = [&](const ThreadBuffer& buffer, int tid, const std::string& name) {
+		file << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid << ", \"args\": {\"name\": " << JsonString(name) << "}}";
+		first = false;
+
+		// complete events with microsecond timestamps
+		ForEachZone(buffer, [&](const ZoneEvent& event) {
+			file << ",\n{\"name\": " << JsonString(event.name) << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid << ", \"ts\": " << event.start / 1e3 << ", \"dur\": " << (event.end - event.start) / 1e3 << "}";
+		});
+	};
+
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		for (auto& buffer : thread_buffers)
+			write_track(*buffer, buffer->id, buffer->name);
+	}
+	write_track(gpu_buffer, 0, "GPU");
+
+	file << "\n]}\n";
+	if (!file)
+	{
+		std::cout << "Error: Cannot write trace " << path << std::endl;
+		return false;
+	}
+	std::cout << "Trace written to " << path << std::endl;
+	return true;
+}
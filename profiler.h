@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "glad/glad.h"
+
+/* Profiler */
+
+// Off until enabled, a disabled zone costs one relaxed load and a branch.
+extern std::atomic<bool> profiler_enabled;
+
+void EnableProfiler(bool enabled);
+
+inline bool IsProfilerEnabled()
+{
+	return profiler_enabled.load(std::memory_order_relaxed);
+}
+
+// Zone names are kept by pointer. Names built at run time, such as mesh keys, are interned here first.
+const char* InternZoneName(const std::string& name);
+
+// Names the calling thread's track in the trace. Does nothing while the profiler is disabled.
+void SetProfilerThreadName(const char* name);
+
+// Records the time between construction and destruction into the calling thread's buffer, a null name records nothing.
+// Each thread appends to a ring of its own, which holds the most recent zones and is never locked.
+struct ProfileZone
+{
+	explicit ProfileZone(const char* name);
+	~ProfileZone();
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* name;
+	uint64_t start;
+};
+
+#define PROFILE_ZONE_JOIN(a, b) a##b
+#define PROFILE_ZONE_NAME(line) PROFILE_ZONE_JOIN(profile_zone_, line)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_ZONE_NAME(__LINE__)(name)
+
+// GPU time of named passes from GL_TIME_ELAPSED queries. Queries of one frame are read two frames later,
+// and only when the driver reports them available, so reading never waits on the GPU. A pass whose
+// result is late is dropped. Passes cannot nest, as time-elapsed queries cannot.
+struct GpuProfiler
+{
+	static const int max_passes = 8;
+	static const int frames_in_flight = 2;
+
+	GpuProfiler() = default;
+	~GpuProfiler();
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	// Collects the finished results of this frame's query set, then reuses the set.
+	void BeginFrame();
+	void BeginPass(const char* name);
+	void EndPass();
+
+	int dropped = 0; // passes whose results were not ready in time
+
+private:
+	struct Pass
+	{
+		GLuint query = 0;
+		const char* name = nullptr;
+		uint64_t cpu_start = 0; // where the pass appears on the trace's GPU track
+		bool pending = false;
+	};
+
+	Pass passes[frames_in_flight][max_passes];
+	int frame = 0;
+	int pass_count = 0;
+	bool in_pass = false;
+};
+
+// Zones from every thread and the GPU within the last window_seconds: count, average and longest per name.
+void PrintProfileSummary(std::ostream& out, double window_seconds = 1.0);
+
+// Quotes and escapes text for a JSON string, for the trace and the benchmark reports.
+std::string JsonString(const std::string& text);
+
+// Writes every recorded zone as Chrome trace events (chrome://tracing, about:tracing or Perfetto).
+// Other threads may keep recording, zones they overwrite meanwhile are left out.
+bool WriteChromeTrace(const std::string& path);
@@ -0,0 +1,206 @@
+#include "program_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "mesh_cache.h"
+#include "opengl_utilities.h"
+
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+/* Parallel Shader Compilation */
+
+static bool parallel_compile = false;
+
+bool EnableParallelShaderCompile(GLADloadproc load)
+{
+	typedef void (APIENTRYP MaxShaderCompilerThreads)(GLuint count);
+
+	MaxShaderCompilerThreads max_threads = nullptr;
+	if (HasExtension("GL_KHR_parallel_shader_compile"))
+		max_threads = reinterpret_cast<MaxShaderCompilerThreads>(load("glMaxShaderCompilerThreadsKHR"));
+	else if (HasExtension("GL_ARB_parallel_shader_compile"))
+		max_threads = reinterpret_cast<MaxShaderCompilerThreads>(load("glMaxShaderCompilerThreadsARB"));
+
+	if (!max_threads)
+		return false;
+
+	// 0xFFFFFFFF leaves the thread count to the driver
+	max_threads(0xFFFFFFFF);
+	parallel_compile = true;
+	return true;
+}
+
+bool IsShaderWorkComplete(GLuint object, bool is_program)
+{
+	if (!parallel_compile)
+		return true;
+
+	GLint complete = GL_TRUE;
+	if (is_program)
+		glGetProgramiv(object, GL_COMPLETION_STATUS_KHR, &complete);
+	else
+		glGetShaderiv(object, GL_COMPLETION_STATUS_KHR, &complete);
+	return complete != GL_FALSE;
+}
+
+/* Program Binary Cache */
+
+static const uint32_t program_cache_magic = 0x47525050; // "PPRG"
+static const uint32_t program_cache_version = 1;
+
+// Followed by length bytes of the binary in the given format.
+struct ProgramCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t length;
+};
+
+typedef void (APIENTRYP ProgramBinary)(GLuint program, GLenum binary_format, const void* binary, GLsizei length);
+typedef void (APIENTRYP GetProgramBinary)(GLuint program, GLsizei buffer_size, GLsizei* length, GLenum* binary_format, void* binary);
+typedef void (APIENTRYP ProgramParameteri)(GLuint program, GLenum parameter, GLint value);
+
+static std::string cache_directory;
+static ProgramBinary program_binary = nullptr;
+static GetProgramBinary get_program_binary = nullptr;
+static ProgramParameteri program_parameteri = nullptr;
+
+void SetProgramBinaryCache(const std::string& directory, GLADloadproc load)
+{
+	cache_directory = "";
+	if (directory.empty())
+		return;
+
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major * 10 + minor >= 41 || HasExtension("GL_ARB_get_program_binary"))
+	{
+		program_binary = reinterpret_cast<ProgramBinary>(load("glProgramBinary"));
+		get_program_binary = reinterpret_cast<GetProgramBinary>(load("glGetProgramBinary"));
+		program_parameteri = reinterpret_cast<ProgramParameteri>(load("glProgramParameteri"));
+	}
+	if (!program_binary || !get_program_binary || !program_parameteri)
+		return;
+
+	GLint format_count = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+	if (format_count <= 0)
+		return;
+
+	cache_directory = directory;
+	MakeCacheDirectory(cache_directory);
+}
+
+void MarkProgramBinaryRetrievable(GLuint program)
+{
+	if (!cache_directory.empty())
+		program_parameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+// 64-bit FNV-1a, continued from hash
+static uint64_t HashString(const char* text, uint64_t hash = 0xCBF29CE484222325ull)
+{
+	for (const char* c = text ? text : ""; ; ++c)
+	{
+		hash ^= uint8_t(*c);
+		hash *= 0x100000001B3ull;
+		if (*c == '\0')
+			return hash;
+	}
+}
+
+std::string ProgramBinaryPath(const char* vertex_shader_source, const char* fragment_shader_source)
+{
+	if (cache_directory.empty())
+		return "";
+
+	// binaries only load on the driver that wrote them, so the driver strings are part of the key
+	uint64_t hash = HashString(vertex_shader_source);
+	hash = HashString(fragment_shader_source, hash);
+	hash = HashString(reinterpret_cast<const char*>(glGetString(GL_VENDOR)), hash);
+	hash = HashString(reinterpret_cast<const char*>(glGetString(GL_RENDERER)), hash);
+	hash = HashString(reinterpret_cast<const char*>(glGetString(GL_VERSION)), hash);
+
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+	return cache_directory + "/" + name + ".program";
+}
+
+bool LoadProgramBinary(GLuint program, const std::string& path)
+{
+	if (path.empty())
+		return false;
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	ProgramCacheHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| header.magic != program_cache_magic || header.version != program_cache_version)
+		return false;
+
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), binary.size()))
+		return false;
+
+	program_binary(program, GLenum(header.format), binary.data(), GLsizei(binary.size()));
+	return true;
+}
+
+void SaveProgramBinary(GLuint program, const std::string& path)
+{
+	if (path.empty())
+		return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	get_program_binary(program, length, &length, &format, binary.data());
+
+	ProgramCacheHeader header;
+	header.magic = program_cache_magic;
+	header.version = program_cache_version;
+	header.format = uint32_t(format);
+	header.length = uint32_t(length);
+
+	// written next to the final name and renamed, as the mesh cache does
+	std::string temporary_path = path + ".tmp";
+	{
+		std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), length);
+		if (!file)
+		{
+			std::cout << "Error: Cannot write program cache " << temporary_path << std::endl;
+			return;
+		}
+	}
+
+	std::remove(path.c_str());
+	std::rename(temporary_path.c_str(), path.c_str());
+}
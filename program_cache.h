@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+#include "glad/glad.h"
+
+/* Parallel Shader Compilation */
+
+// Lets the driver compile and link on its own threads when it offers GL_KHR_parallel_shader_compile
+// or GL_ARB_parallel_shader_compile. load resolves the entry point. Returns whether either is present.
+bool EnableParallelShaderCompile(GLADloadproc load);
+
+// True once the driver has finished compiling or linking, without waiting. Always true without the extension.
+// Program::Poll checks it before the first status query, which would wait.
+bool IsShaderWorkComplete(GLuint object, bool is_program);
+
+/* Program Binary Cache */
+
+// Linked programs are saved to directory and later launches load them instead of compiling. Program binaries
+// are core in 4.1 and come from GL_ARB_get_program_binary on a 3.3 context, load resolves their entry points.
+// An empty directory, a driver without them or without binary formats disables the cache.
+void SetProgramBinaryCache(const std::string& directory, GLADloadproc load);
+
+// Asks the driver to keep program's binary for SaveProgramBinary, before it is linked. Nothing while caching is off.
+void MarkProgramBinaryRetrievable(GLuint program);
+
+// Cache file for the sources on the current driver, empty when caching is off. Needs a current context.
+std::string ProgramBinaryPath(const char* vertex_shader_source, const char* fragment_shader_source);
+
+// Loads the binary into program. Success only means the driver accepted it, check GL_LINK_STATUS as after a link.
+bool LoadProgramBinary(GLuint program, const std::string& path);
+
+void SaveProgramBinary(GLuint program, const std::string& path);
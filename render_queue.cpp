@@ -0,0 +1,204 @@
+#include "render_queue.h"
+
+#include <algorithm>
+
+/* State Cache */
+
+void StateCache::Invalidate()
+{
+	program = nullptr;
+	vertex_array_known = false;
+	draw_attribute_known = false;
+	texture_buffer_known = false;
+	primitive_restart_known = false;
+}
+
+void StateCache::UseProgram(Program& next)
+{
+	if (program == &next)
+	{
+		++elided;
+		return;
+	}
+
+	next.Use();
+	program = &next;
+	++issued;
+}
+
+void StateCache::BindVertexArray(GLuint next)
+{
+	if (vertex_array_known && vertex_array == next)
+	{
+		++elided;
+		return;
+	}
+
+	glBindVertexArray(next);
+	vertex_array = next;
+	vertex_array_known = true;
+	++issued;
+}
+
+// The current value of a generic attribute is context state, it survives vertex array changes.
+void StateCache::SetDrawAttribute(int object, float lod_fade)
+{
+	glm::vec2 value(float(object), lod_fade);
+	if (draw_attribute_known && draw_attribute == value)
+	{
+		++elided;
+		return;
+	}
+
+	glVertexAttrib2f(draw_attribute_location, value.x, value.y);
+	draw_attribute = value;
+	draw_attribute_known = true;
+	++issued;
+}
+
+void StateCache::BindTextureBuffer(GLuint next)
+{
+	if (texture_buffer_known && texture_buffer == next)
+	{
+		++elided;
+		return;
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, next);
+	texture_buffer = next;
+	texture_buffer_known = true;
+	++issued;
+}
+
+// Triangle lists and edges never hold the restart index, but a 32-bit mesh may use 0xFFFF as a vertex, so
+// restart is only on for strips and always at the index of their own type.
+void StateCache::SetPrimitiveRestart(GLenum mode, const VAO& vao)
+{
+	bool enabled = mode == GL_TRIANGLE_STRIP;
+	bool index_changed = enabled && (!primitive_restart_known || restart_index != vao.RestartIndex());
+	if (primitive_restart_known && primitive_restart == enabled && !index_changed)
+	{
+		++elided;
+		return;
+	}
+
+	if (!primitive_restart_known || primitive_restart != enabled)
+	{
+		if (enabled)
+			glEnable(GL_PRIMITIVE_RESTART);
+		else
+			glDisable(GL_PRIMITIVE_RESTART);
+	}
+	if (index_changed)
+	{
+		restart_index = vao.RestartIndex();
+		glPrimitiveRestartIndex(restart_index);
+	}
+	primitive_restart = enabled;
+	primitive_restart_known = true;
+	++issued;
+}
+
+/* Render Queue */
+
+void RenderQueue::Submit(const DrawItem& item)
+{
+	DrawItem sorted = item;
+
+	// most expensive change in the highest bits: program, vertex array, primitive mode, then object entry
+	uint64_t program_bits = item.program->id & 0xFFFF;
+	uint64_t vertex_array_bits = (item.instanced ? item.vao->instance_array : item.vao->id) & 0xFFFFF;
+	uint64_t mode_bits = item.mode & 0xF;
+	uint64_t object_bits = uint64_t(item.object) & 0xFFFFFF;
+	sorted.key = program_bits << 48 | vertex_array_bits << 28 | mode_bits << 24 | object_bits;
+
+	items.push_back(sorted);
+}
+
+void RenderQueue::Flush()
+{
+	// stable, so draws with equal keys (levels of one arena for the same object) keep their submission order and
+	// frames stay deterministic; cross-fading needs no particular order, the two levels dither complementary pixels
+	std::stable_sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+
+	// vertex arrays are bound elsewhere between frames, e.g. when a mesh is pointed at its instances
+	state.Invalidate();
+
+	for (const DrawItem& item : items)
+		if (item.mode == GL_TRIANGLES || item.mode == GL_TRIANGLE_STRIP)
+			triangles += (item.vao->element_array_count / 3) * (item.instanced ? item.vao->instance_count : 1);
+
+	for (size_t i = 0; i < items.size(); )
+	{
+		const DrawItem& item = items[i];
+		const VAO& vao = *item.vao;
+		state.UseProgram(*item.program);
+
+		// no buffers to bind, the vertex shader reads the profile texels and builds the grid from gl_VertexID
+		if (vao.profile_table)
+		{
+			if (profile_program != item.program)
+			{
+				profile_program = item.program;
+				profile_shape = item.program->Find("profile_shape");
+			}
+
+			state.BindVertexArray(vao.id);
+			state.SetDrawAttribute(item.object, item.lod_fade);
+			state.BindTextureBuffer(vao.profile_table->texture);
+			item.program->Set(profile_shape, glm::ivec4(vao.profile_first, vao.profile_samples, vao.rotation_segments, item.mode == GL_LINES));
+
+			GLenum mode = item.mode == GL_TRIANGLE_STRIP ? GL_TRIANGLES : item.mode;
+			glDrawArrays(mode, 0, vao.ElementCount(mode));
+			++draw_calls;
+			++i;
+			continue;
+		}
+
+		// instances need the mesh's own vertex array, everything else in an arena shares the arena's
+		GeometryArena* arena = item.instanced ? nullptr : vao.arena;
+		if (arena)
+		{
+			size_t end = i;
+			arena_draws.clear();
+			for (; end < items.size(); ++end)
+			{
+				const DrawItem& next = items[end];
+				if (next.program != item.program || next.instanced || next.vao->arena != arena || next.mode != item.mode)
+					break;
+				arena_draws.push_back(ArenaDraw{ next.vao, next.object, next.lod_fade });
+			}
+
+			state.BindVertexArray(arena->id);
+			state.SetPrimitiveRestart(item.mode, vao);
+			draw_calls += arena->Draw(item.mode, arena_draws.data(), int(arena_draws.size()));
+
+			// the arena sets the per-draw attribute itself
+			state.draw_attribute_known = false;
+			i = end;
+			continue;
+		}
+
+		state.BindVertexArray(item.instanced ? vao.instance_array : vao.id);
+		state.SetDrawAttribute(item.object, item.lod_fade);
+		state.SetPrimitiveRestart(item.mode, vao);
+
+		if (item.instanced)
+			glDrawElementsInstancedBaseVertex(item.mode, vao.ElementCount(item.mode), vao.index_type, vao.FirstIndex(item.mode), vao.instance_count, vao.base_vertex);
+		else
+			glDrawElementsBaseVertex(item.mode, vao.ElementCount(item.mode), vao.index_type, vao.FirstIndex(item.mode), vao.base_vertex);
+		++draw_calls;
+		++i;
+	}
+
+	items.clear();
+}
+
+void RenderQueue::ResetCounters()
+{
+	state.issued = 0;
+	state.elided = 0;
+	draw_calls = 0;
+	triangles = 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include "opengl_utilities.h"
+
+/* Render Queue */
+
+// One draw. object indexes the Objects uniform block, which holds the transform and material.
+// object and lod_fade reach the shaders through the per-draw attribute, see draw_attribute_location.
+struct DrawItem
+{
+	Program* program;
+	const VAO* vao;
+	GLenum mode;
+	int object;
+	float lod_fade;
+	bool instanced; // draws vao->instance_count instances
+
+	uint64_t key = 0; // filled by Submit
+};
+
+// Current GL bindings as last set through the cache, so repeated binds cost nothing.
+struct StateCache
+{
+	Program* program = nullptr; // null when unknown
+	GLuint vertex_array = 0;
+	bool vertex_array_known = false;
+
+	glm::vec2 draw_attribute;
+	bool draw_attribute_known = false;
+
+	GLuint texture_buffer = 0; // on texture unit 0
+	bool texture_buffer_known = false;
+
+	bool primitive_restart = false; // enabled, at restart_index
+	GLuint restart_index = 0;
+	bool primitive_restart_known = false;
+
+	int issued = 0;
+	int elided = 0;
+
+	// Forgets the bindings, for when code outside the cache may have changed them.
+	void Invalidate();
+
+	void UseProgram(Program& next);
+	void BindVertexArray(GLuint next);
+	void SetDrawAttribute(int object, float lod_fade);
+	void BindTextureBuffer(GLuint next);
+
+	// On at vao's RestartIndex for GL_TRIANGLE_STRIP, off for every other mode.
+	void SetPrimitiveRestart(GLenum mode, const VAO& vao);
+};
+
+// Draws collected over a frame, sorted by a packed state key so that items sharing a program and
+// then a vertex array run back to back, and submitted through a StateCache. Consecutive draws of
+// meshes in the same GeometryArena go out together as one arena draw. Meshes of a ProfileTable are drawn
+// with no vertex buffers, their programs must be SHADER_PULLED variants; they have no strips and draw their
+// triangles in GL_TRIANGLE_STRIP items.
+struct RenderQueue
+{
+	std::vector<DrawItem> items;
+	StateCache state;
+
+	int draw_calls = 0; // glDraw* calls issued, a multi-draw counts once
+	long long triangles = 0; // in GL_TRIANGLES and GL_TRIANGLE_STRIP draws, every instance counted
+
+	void Submit(const DrawItem& item);
+
+	// Sorts and draws every submitted item, then empties the queue.
+	void Flush();
+
+	void ResetCounters();
+
+private:
+	std::vector<ArenaDraw> arena_draws;
+
+	// profile_shape of the last program that drew a pulled mesh
+	Program* profile_program = nullptr;
+	UniformHandle profile_shape;
+};
@@ -0,0 +1,42 @@
+#include "shader_permutations.h"
+
+/* Shader Permutations */
+
+ShaderPermutations::ShaderPermutations(const std::string& version, const GLchar * vertex_shader_source, const GLchar * fragment_shader_source, const std::vector<std::string>& features)
+	: version(version), vertex_source(vertex_shader_source), fragment_source(fragment_shader_source), features(features)
+{
+}
+
+std::string ShaderPermutations::Source(const GLchar * source, unsigned key) const
+{
+	std::string specialised = version + "\n";
+	for (size_t i = 0; i < features.size(); ++i)
+		if (key & (1u << i))
+			specialised += "#define " + features[i] + " 1\n";
+	return specialised + source;
+}
+
+Program& ShaderPermutations::Get(unsigned key)
+{
+	auto found = variants.find(key);
+	if (found != variants.end())
+		return *found->second;
+
+	std::string vertex = Source(vertex_source.c_str(), key);
+	std::string fragment = Source(fragment_source.c_str(), key);
+
+	std::unique_ptr<Program> program(new Program(vertex.c_str(), fragment.c_str()));
+	for (const auto& binding : block_bindings)
+		program->BindUniformBlock(binding.first, binding.second);
+
+	Program& variant = *program;
+	variants[key] = std::move(program);
+	return variant;
+}
+
+void ShaderPermutations::BindUniformBlock(const std::string& name, GLuint binding)
+{
+	block_bindings[name] = binding;
+	for (auto& variant : variants)
+		variant.second->BindUniformBlock(name, binding);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "opengl_utilities.h"
+
+/* Shader Permutations */
+
+// One vertex and one fragment source, specialised by a feature bitmask. Bit i of a key turns into
+// "#define <features[i]> 1" after the #version line. A variant is compiled the first time it is asked for
+// and kept for the rest of the run, so startup pays only for the variants a scene actually draws with.
+struct ShaderPermutations
+{
+	// sources start after the #version line, version is prepended to every variant
+	ShaderPermutations(const std::string& version, const GLchar * vertex_shader_source, const GLchar * fragment_shader_source, const std::vector<std::string>& features);
+
+	Program& Get(unsigned key);
+
+	// Applied to every variant, those already built and those built later.
+	void BindUniformBlock(const std::string& name, GLuint binding);
+
+	std::string Source(const GLchar * source, unsigned key) const;
+
+	std::map<unsigned, std::unique_ptr<Program>> variants;
+
+private:
+	std::string version;
+	std::string vertex_source;
+	std::string fragment_source;
+	std::vector<std::string> features;
+	std::map<std::string, GLuint> block_bindings;
+};
@@ -0,0 +1,464 @@
+#include "simd_generation.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "glm/gtc/constants.hpp"
+
+#include "mesh_generation_core.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define SIMD_X86 0
+#endif
+
+/* Shared Row Data */
+
+// Profile samples in SoA form (padded to 8 floats) and per-row rotation and scale.
+struct RevolvedRows
+{
+	const float* x;
+	const float* y;
+	const float* dx;
+	const float* dy;
+
+	const float* row_cos;
+	const float* row_sin;
+	const float* row_scale;
+	const float* row_dscale;
+	bool modulated;
+
+	int vertical_segments;
+	glm::vec3* positions;
+	glm::vec3* normals;
+};
+
+/* Scalar Lanes */
+
+namespace scalar_kernels
+{
+	struct Lanes
+	{
+		static const int width = 1;
+		float v;
+
+		Lanes() {}
+		Lanes(float v) : v(v) {}
+
+		static Lanes Load(const float* p) { return *p; }
+		void Store(float* p) const { *p = v; }
+	};
+
+	inline unsigned Bits(float f) { unsigned u; std::memcpy(&u, &f, 4); return u; }
+	inline float FromBits(unsigned u) { float f; std::memcpy(&f, &u, 4); return f; }
+	inline Lanes Mask(bool b) { return FromBits(b ? 0xFFFFFFFFu : 0u); }
+
+	inline Lanes operator+(Lanes a, Lanes b) { return a.v + b.v; }
+	inline Lanes operator-(Lanes a, Lanes b) { return a.v - b.v; }
+	inline Lanes operator*(Lanes a, Lanes b) { return a.v * b.v; }
+	inline Lanes operator/(Lanes a, Lanes b) { return a.v / b.v; }
+	inline Lanes operator-(Lanes a) { return -a.v; }
+	inline Lanes Sqrt(Lanes a) { return std::sqrt(a.v); }
+	inline Lanes Round(Lanes a) { return std::nearbyint(a.v); }
+	inline Lanes Floor(Lanes a) { return std::floor(a.v); }
+	inline Lanes Equal(Lanes a, Lanes b) { return Mask(a.v == b.v); }
+	inline Lanes GreaterEqual(Lanes a, Lanes b) { return Mask(a.v >= b.v); }
+	inline Lanes Less(Lanes a, Lanes b) { return Mask(a.v < b.v); }
+	inline Lanes And(Lanes a, Lanes b) { return FromBits(Bits(a.v) & Bits(b.v)); }
+	inline Lanes Or(Lanes a, Lanes b) { return FromBits(Bits(a.v) | Bits(b.v)); }
+	inline Lanes Xor(Lanes a, Lanes b) { return FromBits(Bits(a.v) ^ Bits(b.v)); }
+	inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return Bits(mask.v) ? a : b; }
+
+	#include "simd_kernels.inl"
+}
+
+#if SIMD_X86
+
+/* SSE4.1 Lanes */
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+
+namespace sse4_kernels
+{
+	struct Lanes
+	{
+		static const int width = 4;
+		__m128 v;
+
+		Lanes() {}
+		Lanes(__m128 v) : v(v) {}
+		Lanes(float f) : v(_mm_set1_ps(f)) {}
+
+		static Lanes Load(const float* p) { return _mm_loadu_ps(p); }
+		void Store(float* p) const { _mm_storeu_ps(p, v); }
+	};
+
+	inline Lanes operator+(Lanes a, Lanes b) { return _mm_add_ps(a.v, b.v); }
+	inline Lanes operator-(Lanes a, Lanes b) { return _mm_sub_ps(a.v, b.v); }
+	inline Lanes operator*(Lanes a, Lanes b) { return _mm_mul_ps(a.v, b.v); }
+	inline Lanes operator/(Lanes a, Lanes b) { return _mm_div_ps(a.v, b.v); }
+	inline Lanes operator-(Lanes a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.f)); }
+	inline Lanes Sqrt(Lanes a) { return _mm_sqrt_ps(a.v); }
+	inline Lanes Round(Lanes a) { return _mm_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	inline Lanes Floor(Lanes a) { return _mm_floor_ps(a.v); }
+	inline Lanes Equal(Lanes a, Lanes b) { return _mm_cmpeq_ps(a.v, b.v); }
+	inline Lanes GreaterEqual(Lanes a, Lanes b) { return _mm_cmpge_ps(a.v, b.v); }
+	inline Lanes Less(Lanes a, Lanes b) { return _mm_cmplt_ps(a.v, b.v); }
+	inline Lanes And(Lanes a, Lanes b) { return _mm_and_ps(a.v, b.v); }
+	inline Lanes Or(Lanes a, Lanes b) { return _mm_or_ps(a.v, b.v); }
+	inline Lanes Xor(Lanes a, Lanes b) { return _mm_xor_ps(a.v, b.v); }
+	inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return _mm_blendv_ps(b.v, a.v, mask.v); }
+
+	#include "simd_kernels.inl"
+
+	void SinCosEntry(const float* angles, float* sines, float* cosines, int count) { SinCosBlock(angles, sines, cosines, count); }
+	void ProfileEntry(const ProfileShape& shape, const float* t, float* x, float* y, float* dx, float* dy, int count) { EvaluateProfileBlock(shape, t, x, y, dx, dy, count); }
+	void RowsEntry(const RevolvedRows& rows, int row_begin, int row_end) { GenerateRevolvedRows(rows, row_begin, row_end); }
+	void CullEntry(const float* x, const float* y, const float* z, const float* planes, float radius, float* visible, int count) { CullSpheresBlock(x, y, z, planes, radius, visible, count); }
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+/* AVX2 Lanes */
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace avx2_kernels
+{
+	struct Lanes
+	{
+		static const int width = 8;
+		__m256 v;
+
+		Lanes() {}
+		Lanes(__m256 v) : v(v) {}
+		Lanes(float f) : v(_mm256_set1_ps(f)) {}
+
+		static Lanes Load(const float* p) { return _mm256_loadu_ps(p); }
+		void Store(float* p) const { _mm256_storeu_ps(p, v); }
+	};
+
+	inline Lanes operator+(Lanes a, Lanes b) { return _mm256_add_ps(a.v, b.v); }
+	inline Lanes operator-(Lanes a, Lanes b) { return _mm256_sub_ps(a.v, b.v); }
+	inline Lanes operator*(Lanes a, Lanes b) { return _mm256_mul_ps(a.v, b.v); }
+	inline Lanes operator/(Lanes a, Lanes b) { return _mm256_div_ps(a.v, b.v); }
+	inline Lanes operator-(Lanes a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.f)); }
+	inline Lanes Sqrt(Lanes a) { return _mm256_sqrt_ps(a.v); }
+	inline Lanes Round(Lanes a) { return _mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	inline Lanes Floor(Lanes a) { return _mm256_floor_ps(a.v); }
+	inline Lanes Equal(Lanes a, Lanes b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+	inline Lanes GreaterEqual(Lanes a, Lanes b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+	inline Lanes Less(Lanes a, Lanes b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+	inline Lanes And(Lanes a, Lanes b) { return _mm256_and_ps(a.v, b.v); }
+	inline Lanes Or(Lanes a, Lanes b) { return _mm256_or_ps(a.v, b.v); }
+	inline Lanes Xor(Lanes a, Lanes b) { return _mm256_xor_ps(a.v, b.v); }
+	inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+
+	#include "simd_kernels.inl"
+
+	void SinCosEntry(const float* angles, float* sines, float* cosines, int count) { SinCosBlock(angles, sines, cosines, count); }
+	void ProfileEntry(const ProfileShape& shape, const float* t, float* x, float* y, float* dx, float* dy, int count) { EvaluateProfileBlock(shape, t, x, y, dx, dy, count); }
+	void RowsEntry(const RevolvedRows& rows, int row_begin, int row_end) { GenerateRevolvedRows(rows, row_begin, row_end); }
+	void CullEntry(const float* x, const float* y, const float* z, const float* planes, float radius, float* visible, int count) { CullSpheresBlock(x, y, z, planes, radius, visible, count); }
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif
+
+namespace scalar_kernels
+{
+	void SinCosEntry(const float* angles, float* sines, float* cosines, int count) { SinCosBlock(angles, sines, cosines, count); }
+	void ProfileEntry(const ProfileShape& shape, const float* t, float* x, float* y, float* dx, float* dy, int count) { EvaluateProfileBlock(shape, t, x, y, dx, dy, count); }
+	void RowsEntry(const RevolvedRows& rows, int row_begin, int row_end) { GenerateRevolvedRows(rows, row_begin, row_end); }
+	void CullEntry(const float* x, const float* y, const float* z, const float* planes, float radius, float* visible, int count) { CullSpheresBlock(x, y, z, planes, radius, visible, count); }
+}
+
+/* Runtime Dispatch */
+
+struct SimdKernels
+{
+	SimdPath path;
+	void (*sincos)(const float*, float*, float*, int);
+	void (*profile)(const ProfileShape&, const float*, float*, float*, float*, float*, int);
+	void (*rows)(const RevolvedRows&, int, int);
+	void (*cull)(const float*, const float*, const float*, const float*, float, float*, int);
+};
+
+static const SimdKernels scalar_table = { SIMD_SCALAR, scalar_kernels::SinCosEntry, scalar_kernels::ProfileEntry, scalar_kernels::RowsEntry, scalar_kernels::CullEntry };
+#if SIMD_X86
+static const SimdKernels sse4_table = { SIMD_SSE4, sse4_kernels::SinCosEntry, sse4_kernels::ProfileEntry, sse4_kernels::RowsEntry, sse4_kernels::CullEntry };
+static const SimdKernels avx2_table = { SIMD_AVX2, avx2_kernels::SinCosEntry, avx2_kernels::ProfileEntry, avx2_kernels::RowsEntry, avx2_kernels::CullEntry };
+#endif
+
+static bool CpuSupports(SimdPath path)
+{
+	if (path == SIMD_SCALAR)
+		return true;
+#if SIMD_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+	__cpuid(info, 1);
+	bool sse41 = (info[2] & (1 << 19)) != 0;
+	bool os_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+	bool avx2 = false;
+	if (max_leaf >= 7 && os_avx)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+	return path == SIMD_SSE4 ? sse41 : avx2;
+#else
+	__builtin_cpu_init();
+	return path == SIMD_SSE4 ? __builtin_cpu_supports("sse4.1") != 0 : __builtin_cpu_supports("avx2") != 0;
+#endif
+#else
+	return false;
+#endif
+}
+
+static std::atomic<const SimdKernels*> selected_kernels(nullptr);
+
+static const SimdKernels* ResolveKernels(SimdPath path)
+{
+#if SIMD_X86
+	if ((path == SIMD_AUTO || path == SIMD_AVX2) && CpuSupports(SIMD_AVX2))
+		return &avx2_table;
+	if (path != SIMD_SCALAR && CpuSupports(SIMD_SSE4))
+		return &sse4_table;
+#endif
+	return &scalar_table;
+}
+
+static const SimdKernels& Kernels()
+{
+	const SimdKernels* kernels = selected_kernels.load();
+	if (!kernels)
+	{
+		kernels = ResolveKernels(SIMD_AUTO);
+		selected_kernels.store(kernels);
+	}
+	return *kernels;
+}
+
+void SetSimdPath(SimdPath path)
+{
+	selected_kernels.store(ResolveKernels(path));
+}
+
+SimdPath GetSimdPath()
+{
+	return Kernels().path;
+}
+
+const char* SimdPathName(SimdPath path)
+{
+	switch (path)
+	{
+	case SIMD_SCALAR: return "scalar";
+	case SIMD_SSE4: return "sse4.1";
+	case SIMD_AVX2: return "avx2";
+	default: return "auto";
+	}
+}
+
+/* Batch Evaluation */
+
+// Kernels read whole 8-float blocks, so scratch arrays are rounded up and padded.
+static int PaddedCount(int count)
+{
+	return (count + 7) & ~7;
+}
+
+void EvaluateProfileBatch(const ProfileShape& shape, const float* t, float* x, float* y, float* dx, float* dy, int count)
+{
+	int padded = PaddedCount(count);
+	std::vector<float> scratch(padded * 5, 0.f);
+	std::memcpy(scratch.data(), t, count * sizeof(float));
+
+	float* out = scratch.data() + padded;
+	Kernels().profile(shape, scratch.data(), out, out + padded, out + 2 * padded, out + 3 * padded, padded);
+
+	std::memcpy(x, out, count * sizeof(float));
+	std::memcpy(y, out + padded, count * sizeof(float));
+	std::memcpy(dx, out + 2 * padded, count * sizeof(float));
+	std::memcpy(dy, out + 3 * padded, count * sizeof(float));
+}
+
+void SinCosBatch(const float* angles, float* sines, float* cosines, int count)
+{
+	int padded = PaddedCount(count);
+	std::vector<float> scratch(padded * 3, 0.f);
+	std::memcpy(scratch.data(), angles, count * sizeof(float));
+
+	Kernels().sincos(scratch.data(), scratch.data() + padded, scratch.data() + 2 * padded, padded);
+
+	std::memcpy(sines, scratch.data() + padded, count * sizeof(float));
+	std::memcpy(cosines, scratch.data() + 2 * padded, count * sizeof(float));
+}
+
+void CullSpheresBatch(const float* x, const float* y, const float* z, int count, const glm::vec4 planes[6], float radius, std::vector<GLuint>& visible)
+{
+	int padded = PaddedCount(count);
+	std::vector<float> mask(padded);
+	Kernels().cull(x, y, z, &planes[0].x, radius, mask.data(), padded);
+
+	visible.clear();
+	for (int i = 0; i < count; ++i)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &mask[i], sizeof(bits));
+		if (bits)
+			visible.push_back(GLuint(i));
+	}
+}
+
+/* SIMD Generators */
+
+static void GenerateRevolvedShapeBatched(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const ProfileShape& shape,
+	bool modulated,
+	float frequency,
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool
+)
+{
+	const SimdKernels& kernels = Kernels();
+
+	// the profile is sampled once and shared by every row
+	int padded_v = PaddedCount(vertical_segments);
+	std::vector<float> profile(padded_v * 5);
+	float* t = profile.data();
+	for (int v = 0; v < padded_v; ++v)
+		t[v] = v < vertical_segments ? v / float(vertical_segments - 1) : 1.f;
+	float* x = t + padded_v;
+	float* y = x + padded_v;
+	float* dx = y + padded_v;
+	float* dy = dx + padded_v;
+	kernels.profile(shape, t, x, y, dx, dy, padded_v);
+
+	// at cusps the derivative vanishes, use the chord between the neighbouring samples there
+	for (int v = 0; v < vertical_segments; ++v)
+		if (dx[v] * dx[v] + dy[v] * dy[v] < 1e-10f)
+		{
+			int prev = v > 0 ? v - 1 : v;
+			int next = v < vertical_segments - 1 ? v + 1 : v;
+			dx[v] = x[next] - x[prev];
+			dy[v] = y[next] - y[prev];
+		}
+
+	// one sine and cosine per row for the rotation, two more for the modulation
+	int padded_r = PaddedCount(rotation_segments);
+	std::vector<float> row_data(padded_r * 7, 0.f);
+	float* angle = row_data.data();
+	float* row_sin = angle + padded_r;
+	float* row_cos = row_sin + padded_r;
+	float* row_scale = row_cos + padded_r;
+	float* row_dscale = row_scale + padded_r;
+	float* wave_sin = row_dscale + padded_r;
+	float* wave_cos = wave_sin + padded_r;
+	for (int r = 0; r < rotation_segments; ++r)
+		angle[r] = r / float(rotation_segments) * glm::two_pi<float>();
+	kernels.sincos(angle, row_sin, row_cos, padded_r);
+
+	if (modulated)
+	{
+		for (int r = 0; r < padded_r; ++r)
+			angle[r] *= frequency;
+		kernels.sincos(angle, wave_sin, wave_cos, padded_r);
+	}
+	for (int r = 0; r < rotation_segments; ++r)
+	{
+		row_scale[r] = modulated ? (wave_sin[r] / 2.f + 1.f) * 0.5f : 1.f;
+		row_dscale[r] = modulated ? wave_cos[r] * 0.25f * frequency * glm::two_pi<float>() : 0.f;
+	}
+
+	size_t position_base = positions.size();
+	size_t normal_base = normals.size();
+	size_t index_base = indices.size();
+	positions.resize(position_base + vertical_segments * rotation_segments);
+	normals.resize(normal_base + vertical_segments * rotation_segments);
+	indices.resize(index_base + rotation_segments * (vertical_segments - 1) * 6);
+
+	RevolvedRows rows;
+	rows.x = x;
+	rows.y = y;
+	rows.dx = dx;
+	rows.dy = dy;
+	rows.row_cos = row_cos;
+	rows.row_sin = row_sin;
+	rows.row_scale = row_scale;
+	rows.row_dscale = row_dscale;
+	rows.modulated = modulated;
+	rows.vertical_segments = vertical_segments;
+	rows.positions = &positions[position_base];
+	rows.normals = &normals[normal_base];
+
+	auto generate_rows = [&](int row_begin, int row_end)
+	{
+		kernels.rows(rows, row_begin, row_end);
+		FillGridIndices(&indices[index_base], vertical_segments, rotation_segments, row_begin, row_end);
+	};
+
+	if (pool)
+		pool->ParallelFor(rotation_segments, generate_rows);
+	else
+		generate_rows(0, rotation_segments);
+}
+
+void GenerateRevolvedShapeSIMD(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const ProfileShape& shape,
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool
+)
+{
+	GenerateRevolvedShapeBatched(positions, normals, indices, shape, false, 0.f, vertical_segments, rotation_segments, pool);
+}
+
+void GenerateModulatedRevolvedShapeSIMD(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const ProfileShape& shape,
+	float frequency,
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool
+)
+{
+	GenerateRevolvedShapeBatched(positions, normals, indices, shape, true, frequency, vertical_segments, rotation_segments, pool);
+}
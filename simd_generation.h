@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "glad/glad.h"
+
+#include "thread_pool.h"
+
+/* SIMD Surface Of Revolution Generation */
+
+// Built-in profiles the batch kernels know in closed form, matching ParametricHalfCircle,
+// ParametricCircle and ParametricSpikes in mesh_generation.h.
+enum ProfileCurve
+{
+	PROFILE_HALF_CIRCLE,
+	PROFILE_CIRCLE,
+	PROFILE_SPIKES
+};
+
+// A built-in profile with its parameters. Converts from a bare ProfileCurve with the constants of mesh_generation.h,
+// so PROFILE_SPIKES alone has the 2 + 4 * 2 spikes of ParametricSpikes.
+struct ProfileShape
+{
+	ProfileCurve curve;
+	int spikes; // PROFILE_SPIKES only
+
+	ProfileShape(ProfileCurve curve, int spikes = 2 + 4 * 2) : curve(curve), spikes(spikes) {}
+};
+
+enum SimdPath
+{
+	SIMD_AUTO,
+	SIMD_SCALAR,
+	SIMD_SSE4,
+	SIMD_AVX2
+};
+
+// The widest path the CPU supports is picked on first use. Forcing a path the CPU lacks falls back to the best one available.
+// All paths run the same float operations, so they produce identical meshes.
+void SetSimdPath(SimdPath path);
+SimdPath GetSimdPath();
+const char* SimdPathName(SimdPath path);
+
+// Structure-of-arrays evaluation of a profile and its derivative at count parameters.
+void EvaluateProfileBatch(const ProfileShape& shape, const float* t, float* x, float* y, float* dx, float* dy, int count);
+
+// Structure-of-arrays sine and cosine.
+void SinCosBatch(const float* angles, float* sines, float* cosines, int count);
+
+// Indices of the spheres centred at (x, y, z) that are at least partly on the inner side of all six planes,
+// a plane being inside where dot(plane, vec4(p, 1)) >= 0. The arrays are read in blocks of 8, so they must stay
+// readable up to the next multiple of 8.
+void CullSpheresBatch(const float* x, const float* y, const float* z, int count, const glm::vec4 planes[6], float radius, std::vector<GLuint>& visible);
+
+// Same grid and index layout as GenerateParametricShapeFrom2D, evaluated in float with exact normals.
+void GenerateRevolvedShapeSIMD(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const ProfileShape& shape,
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool = nullptr
+);
+
+// Same as GenerateParametricShapeFrom2D_2 when frequency is 6.
+void GenerateModulatedRevolvedShapeSIMD(
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals,
+	std::vector<GLuint>& indices,
+	const ProfileShape& shape,
+	float frequency,
+	int vertical_segments,
+	int rotation_segments,
+	ThreadPool* pool = nullptr
+);
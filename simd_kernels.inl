@@ -0,0 +1,200 @@
+// Batch kernels written once against a Lanes type.
+// Included by simd_generation.cpp once per instruction set, each time inside its own namespace and target region.
+// Only +, -, *, /, sqrt and exact rounding are used, so every Lanes width gives the same bits.
+
+/* Vectorized Sine And Cosine */
+
+// Cody-Waite reduction to [-PI/4, PI/4] and minimax polynomials, about 1 ulp on the ranges used here.
+inline void SinCos(Lanes x, Lanes& sine, Lanes& cosine)
+{
+	Lanes quadrant = Round(x * Lanes(0.63661977236f));
+
+	Lanes r = x - quadrant * Lanes(1.5703125f);
+	r = r - quadrant * Lanes(4.837512969970703125e-4f);
+	r = r - quadrant * Lanes(7.54978995489188216e-8f);
+	Lanes r2 = r * r;
+
+	Lanes s = r + r * r2 * (Lanes(-1.6666654611e-1f) + r2 * (Lanes(8.3321608736e-3f) + r2 * Lanes(-1.9515295891e-4f)));
+	Lanes c = Lanes(1.f) - r2 * Lanes(0.5f)
+		+ r2 * r2 * (Lanes(4.166664568298827e-2f) + r2 * (Lanes(-1.388731625493765e-3f) + r2 * Lanes(2.443315711809948e-5f)));
+
+	// quadrant modulo 4 picks which polynomial and which sign each result takes
+	Lanes q = quadrant - Lanes(4.f) * Floor(quadrant * Lanes(0.25f));
+	Lanes swap = Or(Equal(q, Lanes(1.f)), Equal(q, Lanes(3.f)));
+	Lanes sine_negative = GreaterEqual(q, Lanes(2.f));
+	Lanes cosine_negative = Or(Equal(q, Lanes(1.f)), Equal(q, Lanes(2.f)));
+
+	Lanes sign_bit(-0.f);
+	sine = Xor(Select(swap, c, s), And(sine_negative, sign_bit));
+	cosine = Xor(Select(swap, s, c), And(cosine_negative, sign_bit));
+}
+
+inline void SinCosBlock(const float* angles, float* sines, float* cosines, int count)
+{
+	for (int i = 0; i < count; i += Lanes::width)
+	{
+		Lanes s, c;
+		SinCos(Lanes::Load(angles + i), s, c);
+		s.Store(sines + i);
+		c.Store(cosines + i);
+	}
+}
+
+/* Profile Curves */
+
+// count must be padded to a multiple of Lanes::width.
+inline void EvaluateProfileBlock(const ProfileShape& shape, const float* t, float* x, float* y, float* dx, float* dy, int count)
+{
+	const float pi = 3.14159265358979f;
+	const float two_pi = 6.28318530717959f;
+
+	for (int i = 0; i < count; i += Lanes::width)
+	{
+		Lanes ti = Lanes::Load(t + i) - Lanes(0.5f);
+		Lanes s, c, px, py, pdx, pdy;
+
+		if (shape.curve == PROFILE_HALF_CIRCLE)
+		{
+			SinCos(ti * Lanes(pi), s, c);
+			px = c;
+			py = s;
+			pdx = -s * Lanes(pi);
+			pdy = c * Lanes(pi);
+		}
+		else if (shape.curve == PROFILE_CIRCLE)
+		{
+			SinCos(ti * Lanes(two_pi), s, c);
+			px = c * Lanes(0.3f) + Lanes(0.7f);
+			py = s * Lanes(0.3f);
+			pdx = -s * Lanes(0.3f * two_pi);
+			pdy = c * Lanes(0.3f * two_pi);
+		}
+		else
+		{
+			const float a = float(shape.spikes);
+			Lanes angle = ti * Lanes(two_pi);
+			Lanes sa, ca;
+			SinCos(angle, s, c);
+			SinCos(angle * Lanes(a), sa, ca);
+			px = (c + sa / Lanes(a)) * Lanes(0.3f) + Lanes(0.7f);
+			py = (s + ca / Lanes(a)) * Lanes(0.3f);
+			pdx = (ca - s) * Lanes(0.3f * two_pi);
+			pdy = (c - sa) * Lanes(0.3f * two_pi);
+		}
+
+		px.Store(x + i);
+		py.Store(y + i);
+		pdx.Store(dx + i);
+		pdy.Store(dy + i);
+	}
+}
+
+/* Revolved Rows */
+
+inline void GenerateRevolvedRows(const RevolvedRows& rows, int row_begin, int row_end)
+{
+	const float two_pi = 6.28318530717959f;
+	const int V = rows.vertical_segments;
+
+	for (int r = row_begin; r < row_end; ++r)
+	{
+		Lanes c(rows.row_cos[r]);
+		Lanes s(rows.row_sin[r]);
+		Lanes m(rows.row_scale[r]);
+		Lanes dm(rows.row_dscale[r]);
+
+		glm::vec3* position_row = rows.positions + r * V;
+		glm::vec3* normal_row = rows.normals + r * V;
+
+		for (int v = 0; v < V; v += Lanes::width)
+		{
+			Lanes x = Lanes::Load(rows.x + v);
+			Lanes y = Lanes::Load(rows.y + v);
+			Lanes dx = Lanes::Load(rows.dx + v);
+			Lanes dy = Lanes::Load(rows.dy + v);
+
+			// rotated profile, then scaled
+			Lanes rx = x * c;
+			Lanes rz = -(x * s);
+			Lanes px = rx * m;
+			Lanes py = y * m;
+			Lanes pz = rz * m;
+
+			// rotated profile normal, exact even at the axis
+			// float rounding leaves points on the axis a few ulps off zero, only flip clearly negative radii
+			Lanes flip = And(Less(x, Lanes(-1e-6f)), Lanes(-0.f));
+			Lanes nx = Xor(dy * c, flip);
+			Lanes ny = Xor(-dx, flip);
+			Lanes nz = Xor(-(dy * s), flip);
+
+			if (rows.modulated)
+			{
+				// cross(tangent_r, tangent_v) with the scale varying along r
+				Lanes tvx = dx * c * m;
+				Lanes tvy = dy * m;
+				Lanes tvz = -(dx * s) * m;
+
+				Lanes spin = m * Lanes(two_pi);
+				Lanes trx = rx * dm - x * s * spin;
+				Lanes try_ = y * dm;
+				Lanes trz = rz * dm - x * c * spin;
+
+				Lanes cx = try_ * tvz - trz * tvy;
+				Lanes cy = trz * tvx - trx * tvz;
+				Lanes cz = trx * tvy - try_ * tvx;
+
+				Lanes degenerate = Equal(cx * cx + cy * cy + cz * cz, Lanes(0.f));
+				nx = Select(degenerate, nx, cx);
+				ny = Select(degenerate, ny, cy);
+				nz = Select(degenerate, nz, cz);
+			}
+
+			Lanes inverse_length = Lanes(1.f) / Sqrt(nx * nx + ny * ny + nz * nz);
+			nx = nx * inverse_length;
+			ny = ny * inverse_length;
+			nz = nz * inverse_length;
+
+			// structure of arrays back to the AoS layout the VAO uploads
+			float block[6][Lanes::width];
+			px.Store(block[0]);
+			py.Store(block[1]);
+			pz.Store(block[2]);
+			nx.Store(block[3]);
+			ny.Store(block[4]);
+			nz.Store(block[5]);
+
+			int n = V - v < Lanes::width ? V - v : Lanes::width;
+			for (int i = 0; i < n; ++i)
+			{
+				position_row[v + i] = glm::vec3(block[0][i], block[1][i], block[2][i]);
+				normal_row[v + i] = glm::vec3(block[3][i], block[4][i], block[5][i]);
+			}
+		}
+	}
+}
+
+/* Frustum Culling */
+
+// Stores an all-ones mask for every sphere of the given radius that is at least partly on the inner
+// side of all six planes (a, b, c, d per plane), zero otherwise. count must be padded to a multiple of Lanes::width.
+inline void CullSpheresBlock(const float* x, const float* y, const float* z, const float* planes, float radius, float* visible, int count)
+{
+	Lanes negative_radius(-radius);
+
+	for (int i = 0; i < count; i += Lanes::width)
+	{
+		Lanes px = Lanes::Load(x + i);
+		Lanes py = Lanes::Load(y + i);
+		Lanes pz = Lanes::Load(z + i);
+
+		Lanes inside = GreaterEqual(px * Lanes(planes[0]) + py * Lanes(planes[1]) + pz * Lanes(planes[2]) + Lanes(planes[3]), negative_radius);
+		for (int p = 1; p < 6; ++p)
+		{
+			const float* plane = planes + p * 4;
+			Lanes distance = px * Lanes(plane[0]) + py * Lanes(plane[1]) + pz * Lanes(plane[2]) + Lanes(plane[3]);
+			inside = And(inside, GreaterEqual(distance, negative_radius));
+		}
+
+		inside.Store(visible + i);
+	}
+}
@@ -0,0 +1,120 @@
+#include "thread_pool.h"
+
+#include "profiler.h"
+
+/* Worker Pool */
+
+ThreadPool::ThreadPool(int thread_count)
+	: task(nullptr), count(0), chunk_size(1), next_begin(0), remaining_chunks(0),
+	  busy_workers(0), generation(0), stopping(false)
+{
+	if (thread_count <= 0)
+		thread_count = int(std::thread::hardware_concurrency());
+	if (thread_count <= 0)
+		thread_count = 1;
+
+	for (int i = 1; i < thread_count; ++i)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+int ThreadPool::ThreadCount() const
+{
+	return int(workers.size()) + 1;
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int, int)>& task)
+{
+	if (count <= 0)
+		return;
+
+	if (workers.empty())
+	{
+		task(0, count);
+		return;
+	}
+
+	std::lock_guard<std::mutex> submit_lock(submit_mutex);
+
+	// a few chunks per thread so uneven rows still balance out
+	int chunk_size = count / (ThreadCount() * 4);
+	if (chunk_size < 1)
+		chunk_size = 1;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = &task;
+		this->count = count;
+		this->chunk_size = chunk_size;
+		next_begin = 0;
+		remaining_chunks = (count + chunk_size - 1) / chunk_size;
+		++generation;
+	}
+	wake.notify_all();
+
+	RunChunks();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return remaining_chunks == 0 && busy_workers == 0; });
+	this->task = nullptr;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	SetProfilerThreadName("Worker");
+
+	unsigned seen_generation = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || (task != nullptr && generation != seen_generation); });
+			if (stopping)
+				return;
+
+			seen_generation = generation;
+			++busy_workers;
+		}
+
+		RunChunks();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			--busy_workers;
+		}
+		done.notify_all();
+	}
+}
+
+void ThreadPool::RunChunks()
+{
+	for (;;)
+	{
+		int begin = next_begin.fetch_add(chunk_size);
+		if (begin >= count)
+			break;
+
+		int end = begin + chunk_size < count ? begin + chunk_size : count;
+		{
+			PROFILE_ZONE("Parallel chunk");
+			(*task)(begin, end);
+		}
+
+		if (--remaining_chunks == 0)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.notify_all();
+		}
+	}
+}
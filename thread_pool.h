@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Worker Pool */
+
+// Threads are started once and reused by every ParallelFor call.
+struct ThreadPool
+{
+	// thread_count counts the calling thread too, 0 picks the hardware concurrency
+	explicit ThreadPool(int thread_count = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int ThreadCount() const;
+
+	// Calls task(begin, end) on chunks covering [0, count) and returns once all chunks are done.
+	// The calling thread works on chunks as well.
+	void ParallelFor(int count, const std::function<void(int, int)>& task);
+
+private:
+	void WorkerLoop();
+	void RunChunks();
+
+	std::vector<std::thread> workers;
+
+	std::mutex submit_mutex;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	const std::function<void(int, int)>* task;
+	int count;
+	int chunk_size;
+	std::atomic<int> next_begin;
+	std::atomic<int> remaining_chunks;
+	int busy_workers;
+	unsigned generation;
+	bool stopping;
+};